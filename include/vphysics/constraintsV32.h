@@ -55,6 +55,17 @@ public:
 	virtual void			GetConstraintSolveInfo(IPhysicsObject32 *pObjA, IPhysicsObject32 *pObjB, physconstraintsolveinfo_t *info, int numRows, float fps, float erp) = 0;
 };
 
+enum constraint_solverhint_t {
+	CONSTRAINT_SOLVER_DEFAULT = 0,	// Solve with the environment's iteration count (plus additionalIterations)
+	CONSTRAINT_SOLVER_ACCURATE,		// Spend extra iterations on this group, for things like ragdolls that need to hold together
+};
+
+abstract_class IPhysicsConstraintGroup32 : public IPhysicsConstraintGroup {
+public:
+	virtual void					SetSolverHint(constraint_solverhint_t hint) = 0;
+	virtual constraint_solverhint_t	GetSolverHint() const = 0;
+};
+
 struct constraint_gearparams_t {
 	constraint_breakableparams_t	constraint; // TODO: Will be supported in the future
 	Vector	objectLocalAxes[2]; // Local axis in objects
@@ -29,6 +29,50 @@ abstract_class IPhysics32 : public IPhysics {
 		virtual int		GetActiveEnvironmentCount() = 0;
 };
 
+// Constraint solver backends, see IPhysicsEnvironment32::SetSolverType
+enum physics_solvertype_t {
+	PHYSICS_SOLVER_SEQUENTIAL_IMPULSE = 0,	// Default. Fast, runs in parallel on multithreaded environments.
+	PHYSICS_SOLVER_NNCG,					// Nonsmooth nonlinear conjugate gradient, converges faster for stacks and chains
+	PHYSICS_SOLVER_MLCP_PGS,				// MLCP solvers are more accurate and a lot more expensive
+	PHYSICS_SOLVER_MLCP_DANTZIG,
+	PHYSICS_SOLVER_MLCP_LEMKE,
+
+	PHYSICS_SOLVER_COUNT
+};
+
+// Continuous collision detection for fast objects, see IPhysicsObject32::SetCCDMode
+// Surfaces can pick a default with a "ccd" key in surfaceproperties ("auto", "off", "always" or "speculative").
+enum physics_ccdmode_t {
+	PHYSICS_CCD_DEFAULT = 0,	// Use the surface's mode, automatic if it doesn't have one
+	PHYSICS_CCD_AUTO,			// Sweep only on steps where the object moves further than a fraction of its smallest extent (bt_ccd_motionfraction)
+	PHYSICS_CCD_DISABLED,
+	PHYSICS_CCD_ALWAYS,			// Sweep every step the object moves at all
+	PHYSICS_CCD_SPECULATIVE,	// Like automatic, but compound objects get contacts ahead of the step instead of a sweep after it.
+								// Cheaper, and the object bounces off with its surface pair's elasticity (pulling back after the sweep kills it)
+
+	PHYSICS_CCD_COUNT
+};
+
+// Decisions taken by the adaptive solver (bt_solver_adaptive), see IPhysicsEnvironment32::ReadSolverStats
+// Counters accumulate until ClearStats is called.
+struct physics_solverstats_t {
+	int		islandsSolved;
+	int		islandsReduced;		// Islands that got fewer than the full iteration count
+	int		iterationsBudgeted;	// Sum of the iteration counts handed to each island
+	int		iterationsSaved;	// Iterations taken away from islands to stay within the time budget
+	float	loadScale;			// Current scale from the step time budget, 1 = not over budget
+	float	lastStepTime;		// Seconds per step, averaged over the last frame that stepped
+};
+
+struct physics_islandstats_t {
+	int		numIslands;			// Islands with at least one moving object, as of the last step
+	int		numSleepingIslands;
+	int		islandsSlept;		// Islands put to sleep as a unit since the stats were cleared
+	int		islandsWoken;		// Sleeping islands woken as a unit since the stats were cleared
+	int		objectsSlept;
+	int		objectsWoken;
+};
+
 abstract_class IPhysicsEnvironment32 : public IPhysicsEnvironment {
 	public:
 #if 0
@@ -46,6 +90,32 @@ abstract_class IPhysicsEnvironment32 : public IPhysicsEnvironment {
 		virtual void	SweepConvex(const CPhysConvex *pConvex, const Vector &vecAbsStart, const Vector &vecAbsEnd, const QAngle &vecAngles, unsigned int fMask, IPhysicsTraceFilter *pTraceFilter, trace_t *pTrace) = 0;
 
 		virtual int		GetObjectCount() const = 0;
+
+		// Number of worker threads this environment's simulation may use, and whether its work is scheduled ahead of other environments.
+		// Pass numThreads <= 0 to follow bt_threadcount again.
+		virtual void	SetThreadBudget(int numThreads, bool highPriority) = 0;
+		virtual int		GetThreadBudget() const = 0;
+
+		// Per environment overrides of bt_solver_iterations and bt_solver_residualthreshold.
+		// Pass iterations <= 0 or threshold < 0 to follow the ConVar again.
+		// Like the ConVars, changes take effect at the start of the next simulation step.
+		virtual void	SetSolverIterations(int iterations) = 0;
+		virtual int		GetSolverIterations() const = 0;
+		virtual void	SetSolverResidualThreshold(float threshold) = 0;
+		virtual float	GetSolverResidualThreshold() const = 0;
+
+		// Overrides bt_solver_type for this environment. The solver is rebuilt at the start of the next simulation step.
+		virtual void					SetSolverType(physics_solvertype_t type) = 0;
+		virtual physics_solvertype_t	GetSolverType() const = 0;
+
+		virtual void	ReadSolverStats(physics_solverstats_t *pOutput) const = 0;
+		virtual void	ReadIslandStats(physics_islandstats_t *pOutput) const = 0;
+
+		// Contacts slower than this (in/s along the contact normal) don't generate collision events, on top of
+		// the per material pair threshold from the surfaceprops hardVelocityThreshold (bt_collision_thresholdscale).
+		// Both are off by default. Pass < 0 to follow bt_collision_minspeed again. Takes effect at the start of the next simulation step.
+		virtual void	SetCollisionEventMinSpeed(float speed) = 0;
+		virtual float	GetCollisionEventMinSpeed() const = 0;
 };
 
 abstract_class IPhysicsObject32 : public IPhysicsObject {
@@ -74,10 +144,53 @@ abstract_class IPhysicsObject32 : public IPhysicsObject {
 		virtual IPhysicsEnvironment32 *GetEnvironment() const = 0;
 
 		virtual IPhysicsVehicleController *GetVehicleController() const = 0;
+
+		// Position for rendering. The environment simulates at a fixed rate, this blends between the last two steps
+		// using the time accumulated since the last one so the client can render smoothly at any frame rate.
+		virtual void		GetInterpolatedPosition(Vector *worldPosition, QAngle *angles) const = 0;
+		virtual void		GetInterpolatedPositionMatrix(matrix3x4_t *positionMatrix) const = 0;
+
+		// Contacts between two objects that both have collision events disabled are dropped before they reach
+		// IPhysicsCollisionEvent, without touching their callback flags. Enabled by default.
+		virtual void		EnableCollisionEvents(bool enable) = 0;
+		virtual bool		IsCollisionEventsEnabled() const = 0;
+
+		// Overrides the CCD mode of our surface. Static objects never use CCD.
+		virtual void		SetCCDMode(physics_ccdmode_t mode) = 0;
+		virtual physics_ccdmode_t GetCCDMode() const = 0;
 };
 
 // Note: If you change anything about a collision shape that an IPhysicsObject is using, call UpdateCollide on that object.
 
+// State of one object handed to IMotionEventBatch::SimulateBatch
+struct motionstate_t {
+	IPhysicsObject *	pObject;
+	Vector				position;			// World space
+	QAngle				angles;
+	Vector				velocity;			// World space
+	AngularImpulse		angularVelocity;	// Local space
+};
+
+// Output of IMotionEventBatch::SimulateBatch, same meaning as the outputs of IMotionEvent::Simulate
+struct motionresult_t {
+	IMotionEvent::simresult_e	mode;
+	Vector						linear;
+	AngularImpulse				angular;
+};
+
+abstract_class IMotionEventBatch {
+	public:
+		// Fill out pResults[i] for pStates[i]. Results are applied after this returns, all at once.
+		virtual void	SimulateBatch(IPhysicsMotionController *pController, const motionstate_t *pStates, motionresult_t *pResults, int count, float deltaTime) = 0;
+};
+
+abstract_class IPhysicsMotionController32 : public IPhysicsMotionController {
+	public:
+		// Optional. When set, it's used instead of the IMotionEvent handler and gets one call per tick
+		// for all attached objects rather than one call per object.
+		virtual void	SetBatchEventHandler(IMotionEventBatch *pHandler) = 0;
+};
+
 abstract_class IPhysicsCollision32 : public IPhysicsCollision {
 	public:
 		// Adds a convex to a collide, with an optional transform to offset the convex.
@@ -3,10 +3,40 @@
 
 class CPhysicsObject;
 
+enum controllerschedule_t {
+	CONTROLLER_SCHEDULE_SUBSTEP = 0,	// Every substep, deltaTime is the substep time
+	CONTROLLER_SCHEDULE_STEP,			// Once per step on its first substep, deltaTime is the step time
+	CONTROLLER_SCHEDULE_FIXED,			// Every GetTickInterval() seconds of simulation time, deltaTime is the interval
+};
+
 class IController {
 	public:
-		// Bullet tick, called post-simulation
+		// Bullet tick, called post-simulation. deltaTime depends on GetSchedule().
 		virtual void Tick(float deltaTime) = 0;
+
+		// When the environment should tick this controller. Must not change while the controller is attached.
+		virtual controllerschedule_t GetSchedule() const { return CONTROLLER_SCHEDULE_SUBSTEP; }
+
+		// Only used with CONTROLLER_SCHEDULE_FIXED
+		virtual float GetTickInterval() const { return 0; }
+
+		// Controllers that never call into game code and only write to their own objects can be
+		// ticked concurrently with controllers that write to different objects.
+		virtual bool IsThreadSafe() const { return false; }
+
+		// Objects written to by Tick(). Only queried for thread safe controllers, and the set must
+		// not change while the controller is attached.
+		virtual int GetControlledObjects(CPhysicsObject **pObjects, int maxObjects) const { return 0; }
+
+		// Slot in the environment's controller list
+		int GetControllerIndex() const { return m_iControllerIndex; }
+		void SetControllerIndex(int index) { m_iControllerIndex = index; }
+
+	protected:
+		IController() : m_iControllerIndex(-1) {}
+
+	private:
+		int m_iControllerIndex;
 };
 
 #endif // ICONTROLLER_H
@@ -0,0 +1,223 @@
+#include "StdAfx.h"
+
+#include "Physics_Buoyancy.h"
+
+#include "LinearMath/btConvexHullComputer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// Adds tetrahedron (p0, a, b, c). Summed over a closed surface this gives its volume and, divided by that, its centroid.
+static inline void AddTetrahedron(const btVector3 &p0, const btVector3 &a, const btVector3 &b, const btVector3 &c, btScalar &volume, btVector3 &moment) {
+	const btScalar tetVolume = (a - p0).dot((b - p0).cross(c - p0)) / btScalar(6);
+	volume += tetVolume;
+	moment += tetVolume * btScalar(0.25) * (p0 + a + b + c);
+}
+
+// Adds the part of triangle abc below the plane as tetrahedra against p0. p0 lies on the plane, so the faces the
+// clipping leaves open on the plane add no volume and don't have to be built.
+static inline void AddClippedTriangle(const btVector3 *pVerts, const btScalar *pDists, const btVector3 &p0, btScalar &volume, btVector3 &moment) {
+	btVector3 clipped[4];
+	int numClipped = 0;
+
+	for (int i = 0; i < 3; i++) {
+		const int next = (i + 1) % 3;
+		if (pDists[i] <= 0)
+			clipped[numClipped++] = pVerts[i];
+
+		if ((pDists[i] <= 0) != (pDists[next] <= 0)) {
+			const btScalar t = pDists[i] / (pDists[i] - pDists[next]);
+			clipped[numClipped++] = pVerts[i] + (pVerts[next] - pVerts[i]) * t;
+		}
+	}
+
+	for (int i = 1; i + 1 < numClipped; i++)
+		AddTetrahedron(p0, clipped[0], clipped[i], clipped[i + 1], volume, moment);
+}
+
+/****************************
+* CLASS CBuoyancyShape
+****************************/
+
+CBuoyancyShape::CBuoyancyShape() {
+	m_volume = 0;
+}
+
+CBuoyancyShape *CBuoyancyShape::Create(const btCollisionShape *pShape) {
+	CBuoyancyShape *pBuoyancy = new CBuoyancyShape;
+	pBuoyancy->AddShape(pShape, btTransform::getIdentity());
+
+	if (pBuoyancy->m_hulls.Count() == 0) {
+		delete pBuoyancy;
+		return NULL;
+	}
+
+	return pBuoyancy;
+}
+
+void CBuoyancyShape::AddShape(const btCollisionShape *pShape, const btTransform &transform) {
+	if (pShape->isCompound()) {
+		const btCompoundShape *pCompound = (const btCompoundShape *)pShape;
+		for (int i = 0; i < pCompound->getNumChildShapes(); i++)
+			AddShape(pCompound->getChildShape(i), transform * pCompound->getChildTransform(i));
+	} else if (pShape->getShapeType() == SPHERE_PROXYTYPE) {
+		const btScalar radius = ((const btSphereShape *)pShape)->getRadius();
+
+		hull_t &hull = m_hulls[m_hulls.AddToTail()];
+		hull.center = transform.getOrigin();
+		hull.radius = radius;
+		hull.centroid = hull.center;
+		hull.volume = btScalar(4.0 / 3.0) * SIMD_PI * radius * radius * radius;
+		hull.firstIndex = 0;
+		hull.numIndices = 0;
+		hull.isSphere = true;
+
+		m_volume += hull.volume;
+	} else if (pShape->isPolyhedral()) {
+		// Convex hulls and boxes. Anything else (capsules, cones) doesn't come out of the collision interface.
+		const btPolyhedralConvexShape *pPolyhedral = (const btPolyhedralConvexShape *)pShape;
+
+		CUtlVector<btVector3> points;
+		points.SetCount(pPolyhedral->getNumVertices());
+		for (int i = 0; i < points.Count(); i++)
+			pPolyhedral->getVertex(i, points[i]);
+
+		AddHull(points.Base(), points.Count(), transform);
+	}
+}
+
+void CBuoyancyShape::AddHull(const btVector3 *pPoints, int numPoints, const btTransform &transform) {
+	if (numPoints < 4) return;
+
+	// Hull points don't come with faces, so build them
+	btConvexHullComputer hullComputer;
+	hullComputer.compute(pPoints[0].m_floats, sizeof(btVector3), numPoints, 0, 0);
+	if (hullComputer.faces.size() < 4) return;
+
+	hull_t hull;
+	hull.firstIndex = m_indices.Count();
+	hull.isSphere = false;
+
+	const int firstVertex = m_vertices.Count();
+	btVector3 center(0, 0, 0);
+	for (int i = 0; i < hullComputer.vertices.size(); i++) {
+		const btVector3 vertex = transform * hullComputer.vertices[i];
+		m_vertices.AddToTail(vertex);
+		center += vertex;
+	}
+
+	center /= btScalar(hullComputer.vertices.size());
+
+	hull.center = center;
+	hull.radius = 0;
+	for (int i = firstVertex; i < m_vertices.Count(); i++)
+		hull.radius = btMax(hull.radius, (m_vertices[i] - center).length());
+
+	// Fan out every face
+	for (int i = 0; i < hullComputer.faces.size(); i++) {
+		const btConvexHullComputer::Edge *pFirstEdge = &hullComputer.edges[hullComputer.faces[i]];
+		const btConvexHullComputer::Edge *pEdge = pFirstEdge->getNextEdgeOfFace();
+		const int first = firstVertex + pFirstEdge->getSourceVertex();
+
+		for (const btConvexHullComputer::Edge *pNext = pEdge->getNextEdgeOfFace(); pNext != pFirstEdge; pEdge = pNext, pNext = pNext->getNextEdgeOfFace()) {
+			m_indices.AddToTail(first);
+			m_indices.AddToTail(firstVertex + pEdge->getSourceVertex());
+			m_indices.AddToTail(firstVertex + pNext->getSourceVertex());
+		}
+	}
+
+	hull.numIndices = m_indices.Count() - hull.firstIndex;
+
+	btScalar volume = 0;
+	btVector3 moment(0, 0, 0);
+	for (int i = hull.firstIndex; i < hull.firstIndex + hull.numIndices; i += 3)
+		AddTetrahedron(center, m_vertices[m_indices[i]], m_vertices[m_indices[i + 1]], m_vertices[m_indices[i + 2]], volume, moment);
+
+	// Clipping relies on the triangles facing out
+	if (volume < 0) {
+		for (int i = hull.firstIndex; i < hull.firstIndex + hull.numIndices; i += 3)
+			V_swap(m_indices[i + 1], m_indices[i + 2]);
+
+		volume = -volume;
+		moment = -moment;
+	}
+
+	// Flat hull
+	if (volume <= SIMD_EPSILON) {
+		m_vertices.RemoveMultipleFromTail(m_vertices.Count() - firstVertex);
+		m_indices.RemoveMultipleFromTail(hull.numIndices);
+		return;
+	}
+
+	hull.volume = volume;
+	hull.centroid = moment / volume;
+	m_hulls.AddToTail(hull);
+	m_volume += volume;
+}
+
+btScalar CBuoyancyShape::ComputeSubmerged(const btVector3 &normal, btScalar dist, btVector3 &center) const {
+	btScalar volume = 0;
+	btVector3 moment(0, 0, 0);
+
+	for (int i = 0; i < m_hulls.Count(); i++) {
+		const hull_t &hull = m_hulls[i];
+		const btScalar centerDist = normal.dot(hull.center) - dist;
+
+		// Dry
+		if (centerDist >= hull.radius)
+			continue;
+
+		if (hull.isSphere) {
+			btVector3 capCenter;
+			const btScalar capVolume = ComputeSphereSubmerged(hull.center, hull.radius, normal, dist, capCenter);
+			volume += capVolume;
+			moment += capCenter * capVolume;
+			continue;
+		}
+
+		// Fully submerged
+		if (centerDist <= -hull.radius) {
+			volume += hull.volume;
+			moment += hull.centroid * hull.volume;
+			continue;
+		}
+
+		const btVector3 p0 = hull.center - normal * centerDist;
+
+		btVector3 verts[3];
+		btScalar dists[3];
+		for (int j = hull.firstIndex; j < hull.firstIndex + hull.numIndices; j += 3) {
+			bool anySubmerged = false;
+			for (int k = 0; k < 3; k++) {
+				verts[k] = m_vertices[m_indices[j + k]];
+				dists[k] = normal.dot(verts[k]) - dist;
+				anySubmerged |= dists[k] <= 0;
+			}
+
+			if (anySubmerged)
+				AddClippedTriangle(verts, dists, p0, volume, moment);
+		}
+	}
+
+	if (volume <= SIMD_EPSILON) {
+		center.setZero();
+		return 0;
+	}
+
+	center = moment / volume;
+	return volume;
+}
+
+btScalar CBuoyancyShape::ComputeSphereSubmerged(const btVector3 &sphereCenter, btScalar radius, const btVector3 &normal, btScalar dist, btVector3 &center) {
+	const btScalar depth = btClamped(radius - (normal.dot(sphereCenter) - dist), btScalar(0), 2 * radius);
+	if (depth <= 0) {
+		center = sphereCenter;
+		return 0;
+	}
+
+	// The cap's centroid sits this far below the sphere's center
+	const btScalar offset = btScalar(3) * (2 * radius - depth) * (2 * radius - depth) / (btScalar(4) * (3 * radius - depth));
+	center = sphereCenter - normal * offset;
+
+	return SIMD_PI * depth * depth * (3 * radius - depth) / btScalar(3);
+}
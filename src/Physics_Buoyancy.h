@@ -0,0 +1,46 @@
+#ifndef PHYSICS_BUOYANCY_H
+#define PHYSICS_BUOYANCY_H
+#if defined(_MSC_VER) || (defined(__GNUC__) && __GNUC__ > 3)
+	#pragma once
+#endif
+
+// Closed triangle meshes of every convex hull in a collision shape, for working out how much of it is under water.
+// Built once per CPhysCollide (see CPhysCollide::GetBuoyancyShape) and shared by every object using it.
+// Everything is in the space of the collision shape, so callers move the surface plane into it instead.
+class CBuoyancyShape {
+	public:
+		// NULL if the shape has nothing with a volume in it
+		static CBuoyancyShape *	Create(const btCollisionShape *pShape);
+
+		// The plane is normal.dot(x) = dist, anything on the negative side is submerged.
+		// Returns the submerged volume (m^3) and its centroid in center.
+		btScalar				ComputeSubmerged(const btVector3 &normal, btScalar dist, btVector3 &center) const;
+
+		btScalar				GetVolume() const { return m_volume; }
+
+		// Spherical cap below the plane, for sphere objects which don't have a CPhysCollide
+		static btScalar			ComputeSphereSubmerged(const btVector3 &sphereCenter, btScalar radius, const btVector3 &normal, btScalar dist, btVector3 &center);
+
+	private:
+		struct hull_t {
+			btVector3	center;		// Bounding sphere, for skipping dry and fully submerged hulls
+			btScalar	radius;
+			btVector3	centroid;	// Of the whole hull
+			btScalar	volume;
+			int			firstIndex;	// Into m_indices, 3 per triangle
+			int			numIndices;
+			bool		isSphere;
+		};
+
+								CBuoyancyShape();
+
+		void					AddShape(const btCollisionShape *pShape, const btTransform &transform);
+		void					AddHull(const btVector3 *pPoints, int numPoints, const btTransform &transform);
+
+		CUtlVector<hull_t>		m_hulls;
+		CUtlVector<btVector3>	m_vertices;
+		CUtlVector<int>			m_indices;
+		btScalar				m_volume;
+};
+
+#endif // PHYSICS_BUOYANCY_H
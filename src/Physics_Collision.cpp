@@ -7,6 +7,7 @@
 #include "LinearMath/btConvexHull.h"
 
 #include "Physics_Collision.h"
+#include "Physics_Buoyancy.h"
 #include "Physics_Object.h"
 #include "convert.h"
 #include "Physics_KeyParser.h"
@@ -181,10 +182,32 @@ END_BYTESWAP_DATADESC()
 CPhysCollide::CPhysCollide(btCollisionShape *pShape) {
 	m_pShape = pShape;
 	m_pShape->setUserPointer(this);
+	m_iObjectRefs = 0;
+	m_pBuoyancy = NULL;
+	m_bBuoyancyBuilt = false;
 
 	m_massCenter.setZero();
 }
 
+CPhysCollide::~CPhysCollide() {
+	delete m_pBuoyancy;
+}
+
+const CBuoyancyShape *CPhysCollide::GetBuoyancyShape() {
+	if (!m_bBuoyancyBuilt) {
+		m_pBuoyancy = CBuoyancyShape::Create(m_pShape);
+		m_bBuoyancyBuilt = true;
+	}
+
+	return m_pBuoyancy;
+}
+
+void CPhysCollide::InvalidateBuoyancyShape() {
+	delete m_pBuoyancy;
+	m_pBuoyancy = NULL;
+	m_bBuoyancyBuilt = false;
+}
+
 /****************************
 * CLASS CPhysPolySoup
 ****************************/
@@ -496,6 +519,7 @@ void CPhysicsCollision::AddConvexToCollide(CPhysCollide *pCollide, const CPhysCo
 		}
 
 		pCompound->addChildShape(trans, pShape);
+		pCollide->InvalidateBuoyancyShape();
 	}
 }
 
@@ -508,6 +532,7 @@ void CPhysicsCollision::RemoveConvexFromCollide(CPhysCollide *pCollide, const CP
 
 		// FIXME: Need to recalculate the aabb tree or something
 		pCompound->removeChildShape(pShape);
+		pCollide->InvalidateBuoyancyShape();
 	}
 }
 
@@ -730,6 +755,8 @@ void CPhysicsCollision::CollideSetMassCenter(CPhysCollide *pCollide, const Vecto
 			childTrans.setOrigin(childTrans.getOrigin() + offset);
 			pCompound->updateChildTransform(i, childTrans);
 		}
+
+		pCollide->InvalidateBuoyancyShape();
 	}
 
 	pCollide->SetMassCenter(bullMassCenter);
@@ -757,6 +784,7 @@ void CPhysicsCollision::CollideSetScale(CPhysCollide *pCollide, const Vector &sc
 		bullScale.setZ(scale.y);
 
 		pCompound->setLocalScaling(bullScale);
+		pCollide->InvalidateBuoyancyShape();
 	}
 }
 
@@ -16,9 +16,12 @@ struct bboxcache_t {
 	Vector			mins, maxs;
 };
 
+class CBuoyancyShape;
+
 class CPhysCollide {
 	public:
 		CPhysCollide(btCollisionShape *pShape);
+		~CPhysCollide();
 
 		const btCollisionShape *GetCollisionShape() const {
 			return m_pShape;
@@ -92,8 +95,32 @@ class CPhysCollide {
 			return m_pShape->isConvex();
 		}
 
+		// Physics objects using this collide in any environment, see IPhysicsEnvironment::IsCollisionModelUsed
+		void AddObjectRef() {
+			m_iObjectRefs++;
+		}
+
+		void RemoveObjectRef() {
+			Assert(m_iObjectRefs > 0);
+			m_iObjectRefs--;
+		}
+
+		int GetObjectRefs() const {
+			return m_iObjectRefs;
+		}
+
+		// Built the first time an object using us touches water. NULL if we have no volume.
+		const CBuoyancyShape *GetBuoyancyShape();
+
+		// Call whenever the shape changes
+		void InvalidateBuoyancyShape();
+
 	private:
 		btCollisionShape *m_pShape;
+		int m_iObjectRefs;
+
+		CBuoyancyShape *m_pBuoyancy;
+		bool m_bBuoyancyBuilt;
 
 		btVector3 m_rotInertia;
 		btVector3 m_massCenter;
@@ -637,6 +637,7 @@ btTypedConstraint *CPhysicsConstraint::GetConstraint() {
 
 CPhysicsConstraintGroup::CPhysicsConstraintGroup(CPhysicsEnvironment *pEnv, const constraint_groupparams_t &params) {
 	m_errorParams = params;
+	m_solverHint = CONSTRAINT_SOLVER_DEFAULT;
 	m_pEnvironment = pEnv;
 }
 
@@ -668,15 +669,42 @@ void CPhysicsConstraintGroup::GetErrorParams(constraint_groupparams_t *pParams)
 
 void CPhysicsConstraintGroup::SetErrorParams(const constraint_groupparams_t &params) {
 	m_errorParams = params;
+	UpdateSolverIterations();
 }
 
 void CPhysicsConstraintGroup::SolvePenetration(IPhysicsObject *pObj0, IPhysicsObject *pObj1) {
 	NOT_IMPLEMENTED
 }
 
+void CPhysicsConstraintGroup::SetSolverHint(constraint_solverhint_t hint) {
+	m_solverHint = hint;
+	UpdateSolverIterations();
+}
+
+// Bullet can't pick a different solver per island, so the hint buys accuracy with extra iterations instead
+int CPhysicsConstraintGroup::GetSolverIterations() const {
+	if (m_solverHint == CONSTRAINT_SOLVER_DEFAULT && m_errorParams.additionalIterations <= 0)
+		return -1; // Use the world's
+
+	int iterations = m_pEnvironment->GetSolverIterations();
+	if (m_solverHint == CONSTRAINT_SOLVER_ACCURATE)
+		iterations *= 4;
+
+	return iterations + max(m_errorParams.additionalIterations, 0);
+}
+
+// UNEXPOSED
+void CPhysicsConstraintGroup::UpdateSolverIterations() {
+	const int iterations = GetSolverIterations();
+	for (int i = 0; i < m_constraints.Count(); i++) {
+		m_constraints[i]->GetConstraint()->setOverrideNumSolverIterations(iterations);
+	}
+}
+
 // UNEXPOSED
 void CPhysicsConstraintGroup::AddConstraint(CPhysicsConstraint *pConstraint) {
 	m_constraints.AddToTail(pConstraint);
+	pConstraint->GetConstraint()->setOverrideNumSolverIterations(GetSolverIterations());
 }
 
 // UNEXPOSED
@@ -92,7 +92,7 @@ class CPhysicsSpring : public IPhysicsSpring, public CPhysicsConstraint {
 
 // FIXME: I dont think we can implement this in Bullet anyways?
 // We'll have to emulate this on bullet.
-class CPhysicsConstraintGroup : public IPhysicsConstraintGroup
+class CPhysicsConstraintGroup : public IPhysicsConstraintGroup32
 {
 	public:
 		CPhysicsConstraintGroup(CPhysicsEnvironment *pEnv, const constraint_groupparams_t &params);
@@ -105,14 +105,23 @@ class CPhysicsConstraintGroup : public IPhysicsConstraintGroup
 		void	SetErrorParams(const constraint_groupparams_t &params);
 		void	SolvePenetration(IPhysicsObject *pObj0, IPhysicsObject *pObj1);
 
+		void					SetSolverHint(constraint_solverhint_t hint);
+		constraint_solverhint_t	GetSolverHint() const { return m_solverHint; }
+
 	public:
 		// Unexposed functions
 		void	AddConstraint(CPhysicsConstraint *pConstraint);
 		void	RemoveConstraint(CPhysicsConstraint *pConstraint);
 
+		// Call when the environment's iteration count changes
+		void	UpdateSolverIterations();
+
 	private:
+		int		GetSolverIterations() const;
+
 		CUtlVector<CPhysicsConstraint *>	m_constraints;
 		constraint_groupparams_t			m_errorParams;
+		constraint_solverhint_t				m_solverHint;
 		CPhysicsEnvironment *				m_pEnvironment;
 };
 
@@ -25,58 +25,159 @@ float CPhysicsDragController::GetAirDensity() {
 }
 
 void CPhysicsDragController::RemovePhysicsObject(CPhysicsObject *obj) {
-	m_ents.FindAndRemove(obj);
+	const int index = obj->GetDragIndex();
+	if (index == -1) return;
+
+	Assert(m_ents[index] == obj);
+
+	// Swap remove, then fix up the index of the object that got moved into our slot
+	m_ents.FastRemove(index);
+	m_entBodies.FastRemove(index);
+	for (int i = 0; i < 3; i++) {
+		m_entDragBasis[i].FastRemove(index);
+		m_entAngDragBasis[i].FastRemove(index);
+	}
+
+	if (index < m_ents.Count())
+		m_ents[index]->SetDragIndex(index);
+
+	obj->SetDragIndex(-1);
 }
 
 void CPhysicsDragController::AddPhysicsObject(CPhysicsObject *obj) {
 	if (!IsControlling(obj)) {
-		m_ents.AddToTail(obj);
+		obj->SetDragIndex(m_ents.AddToTail(obj));
+		m_entBodies.AddToTail(obj->GetObject());
+		for (int i = 0; i < 3; i++) {
+			m_entDragBasis[i].AddToTail();
+			m_entAngDragBasis[i].AddToTail();
+		}
+
+		UpdateDragBasis(obj);
+	}
+}
+
+void CPhysicsDragController::UpdateDragBasis(CPhysicsObject *obj) {
+	const int index = obj->GetDragIndex();
+	if (index == -1) return;
+
+	const btVector3 dragBasis = obj->GetDragBasis().absolute() * obj->GetDragCoefficient();
+	const btVector3 angDragBasis = obj->GetAngularDragBasis().absolute() * obj->GetAngularDragCoefficient();
+	for (int i = 0; i < 3; i++) {
+		m_entDragBasis[i][index] = dragBasis[i];
+		m_entAngDragBasis[i][index] = angDragBasis[i];
 	}
 }
 
 bool CPhysicsDragController::IsControlling(const CPhysicsObject *obj) const {
-	return m_ents.Find((CPhysicsObject *)obj) != -1;
+	return obj->GetDragIndex() != -1;
 }
 
-void CPhysicsDragController::Tick(btScalar dt) {
-	for (int i = 0; i < m_ents.Count(); i++) {
-		CPhysicsObject *pObject = (CPhysicsObject *)m_ents[i];
-		btRigidBody *body = pObject->GetObject();
+int CPhysicsDragController::PackAwakeObjects() {
+	// Worst case size up front, so the loop below doesn't have to grow anything
+	const int maxCount = m_entBodies.Count();
+	m_bodies.SetCount(maxCount);
+	for (int i = 0; i < 3; i++) {
+		m_linVel[i].SetCount(maxCount);
+		m_angVel[i].SetCount(maxCount);
+		m_dragBasis[i].SetCount(maxCount);
+		m_angDragBasis[i].SetCount(maxCount);
+	}
+
+	for (int i = 0; i < 9; i++) {
+		m_rotation[i].SetCount(maxCount);
+	}
+
+	m_linScale.SetCount(maxCount);
+	m_angScale.SetCount(maxCount);
+
+	// Only the velocities and rotations change between ticks, the drag bases come straight from our own arrays
+	int count = 0;
+	for (int i = 0; i < maxCount; i++) {
+		btRigidBody *body = m_entBodies[i];
 		if (body->getActivationState() == ISLAND_SLEEPING || body->getActivationState() == DISABLE_SIMULATION)
 			continue;
 
-		//------------------
-		// LINEAR DRAG
-		//------------------
-		if (!btFuzzyZero(body->getLinearVelocity().length2())) {
-			btVector3 vel(0, 0, 0);
+		const btVector3 &linVel = body->getLinearVelocity();
+		const btVector3 &angVel = body->getAngularVelocity();
+		const btMatrix3x3 &basis = body->getCenterOfMassTransform().getBasis();
 
-			float dragForce = -1 * pObject->GetDragInDirection(body->getLinearVelocity().normalized()) * m_airDensity * dt;
-			if (dragForce < -1.0f)
-				dragForce = -1.0f;
+		for (int j = 0; j < 3; j++) {
+			m_linVel[j][count] = linVel[j];
+			m_angVel[j][count] = angVel[j];
+			m_dragBasis[j][count] = m_entDragBasis[j][i];
+			m_angDragBasis[j][count] = m_entAngDragBasis[j][i];
 
-			// If the drag force actually drags
-			if (dragForce < 0)
-				vel = body->getLinearVelocity() * dragForce;
-
-			body->setLinearVelocity(body->getLinearVelocity() + vel);
+			m_rotation[j * 3 + 0][count] = basis[j][0];
+			m_rotation[j * 3 + 1][count] = basis[j][1];
+			m_rotation[j * 3 + 2][count] = basis[j][2];
 		}
 
-		//------------------
-		// ANGULAR DRAG
-		//------------------
-		if (!btFuzzyZero(body->getAngularVelocity().length2())) {
-			btVector3 ang(0, 0, 0);
+		m_bodies[count++] = body;
+	}
 
-			float angDragForce = -1 * pObject->GetAngularDragInDirection(body->getAngularVelocity().normalized()) * m_airDensity * dt;
-			if (angDragForce < -1.0f)
-				angDragForce = -1.0f;
+	return count;
+}
 
-			// If the drag force actually drags
-			if (angDragForce < 0)
-				ang = body->getAngularVelocity() * angDragForce;
+void CPhysicsDragController::Tick(btScalar dt) {
+	// Arrays are sized for every controlled object, only the first count entries are valid this tick
+	const int count = PackAwakeObjects();
+	if (count == 0)
+		return;
+
+	const float scale = m_airDensity * dt;
+
+	//------------------
+	// LINEAR DRAG
+	//------------------
+	{
+		const float *vx = m_linVel[0].Base(), *vy = m_linVel[1].Base(), *vz = m_linVel[2].Base();
+		const float *bx = m_dragBasis[0].Base(), *by = m_dragBasis[1].Base(), *bz = m_dragBasis[2].Base();
+		const float *m00 = m_rotation[0].Base(), *m01 = m_rotation[1].Base(), *m02 = m_rotation[2].Base();
+		const float *m10 = m_rotation[3].Base(), *m11 = m_rotation[4].Base(), *m12 = m_rotation[5].Base();
+		const float *m20 = m_rotation[6].Base(), *m21 = m_rotation[7].Base(), *m22 = m_rotation[8].Base();
+		float *out = m_linScale.Base();
+
+		for (int i = 0; i < count; i++) {
+			const float len2 = vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i];
+			const float invLen = len2 < SIMD_EPSILON ? 0.f : 1.f / sqrtf(len2);
+
+			// Velocity in object space (transpose multiply, see BtMatrix_vimult)
+			const float lx = m00[i] * vx[i] + m10[i] * vy[i] + m20[i] * vz[i];
+			const float ly = m01[i] * vx[i] + m11[i] * vy[i] + m21[i] * vz[i];
+			const float lz = m02[i] * vx[i] + m12[i] * vy[i] + m22[i] * vz[i];
+
+			const float dragForce = -(fabsf(lx) * bx[i] + fabsf(ly) * by[i] + fabsf(lz) * bz[i]) * invLen * scale;
+			out[i] = dragForce < -1.f ? -1.f : dragForce;
+		}
+	}
 
-			body->setAngularVelocity(body->getAngularVelocity() + ang);
+	//------------------
+	// ANGULAR DRAG
+	//------------------
+	{
+		const float *wx = m_angVel[0].Base(), *wy = m_angVel[1].Base(), *wz = m_angVel[2].Base();
+		const float *bx = m_angDragBasis[0].Base(), *by = m_angDragBasis[1].Base(), *bz = m_angDragBasis[2].Base();
+		float *out = m_angScale.Base();
+
+		for (int i = 0; i < count; i++) {
+			const float len2 = wx[i] * wx[i] + wy[i] * wy[i] + wz[i] * wz[i];
+			const float invLen = len2 < SIMD_EPSILON ? 0.f : 1.f / sqrtf(len2);
+
+			const float angDragForce = -(fabsf(wx[i]) * bx[i] + fabsf(wy[i]) * by[i] + fabsf(wz[i]) * bz[i]) * invLen * scale;
+			out[i] = angDragForce < -1.f ? -1.f : angDragForce;
 		}
 	}
-}
\ No newline at end of file
+
+	// Write everything back in one pass
+	for (int i = 0; i < count; i++) {
+		btRigidBody *body = m_bodies[i];
+
+		// If the drag force actually drags
+		if (m_linScale[i] < 0)
+			body->setLinearVelocity(body->getLinearVelocity() * (1.f + m_linScale[i]));
+
+		if (m_angScale[i] < 0)
+			body->setAngularVelocity(body->getAngularVelocity() * (1.f + m_angScale[i]));
+	}
+}
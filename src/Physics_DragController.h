@@ -14,12 +14,31 @@ class CPhysicsDragController {
 
 		void						AddPhysicsObject(CPhysicsObject *pObject);
 		void						RemovePhysicsObject(CPhysicsObject *pObject);
+		void						UpdateDragBasis(CPhysicsObject *pObject); // Call when the object's drag coefficients change
 		void						Tick(btScalar dt);
 		bool						IsControlling(const CPhysicsObject *pObject) const;
 	private:
+		int							PackAwakeObjects(); // Returns the number of awake objects packed
+
 		float						m_airDensity;
 
 		CUtlVector<CPhysicsObject *>m_ents;
+
+		// Parallel to m_ents, only touched when objects are added, removed or change drag coefficients
+		CUtlVector<btRigidBody *>	m_entBodies;
+		CUtlVector<float>			m_entDragBasis[3];		// Pre-multiplied by the drag coefficient
+		CUtlVector<float>			m_entAngDragBasis[3];	// Pre-multiplied by the angular drag coefficient
+
+		// Awake subset of m_ents, packed as structure of arrays every tick so the
+		// drag math runs as straight loops over contiguous floats.
+		CUtlVector<btRigidBody *>	m_bodies;
+		CUtlVector<float>			m_linVel[3];
+		CUtlVector<float>			m_angVel[3];
+		CUtlVector<float>			m_dragBasis[3];
+		CUtlVector<float>			m_angDragBasis[3];
+		CUtlVector<float>			m_rotation[9];		// Row major basis
+		CUtlVector<float>			m_linScale;
+		CUtlVector<float>			m_angScale;
 };
 
-#endif // PHYSICS_DRAGCONTROLLER_H
\ No newline at end of file
+#endif // PHYSICS_DRAGCONTROLLER_H
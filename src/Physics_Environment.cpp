@@ -2,6 +2,8 @@
 
 #include <cmodel.h>
 #include <cstring>
+#include <tier1/utlmap.h>
+#include <utlhashtable.h>
 
 #include "Physics_Environment.h"
 #include "Physics.h"
@@ -14,6 +16,10 @@
 #include "Physics_Constraint.h"
 #include "Physics_Collision.h"
 #include "Physics_VehicleController.h"
+#include "Physics_SurfaceProps.h"
+#include "Physics_TaskScheduler.h"
+#include "Physics_ObjectPool.h"
+#include "Physics_FrictionSnapshot.h"
 #include "miscmath.h"
 #include "convert.h"
 
@@ -22,6 +28,7 @@
 #endif
 
 #include "BulletCollision/CollisionDispatch/btDefaultCollisionConfiguration.h"
+#include "BulletCollision/CollisionDispatch/btManifoldResult.h"
 #include "BulletDynamics/MLCPSolvers/btMLCPSolver.h"
 #include "BulletDynamics/MLCPSolvers/btLemkeSolver.h"
 #include "BulletDynamics/MLCPSolvers/btDantzigSolver.h"
@@ -30,6 +37,10 @@
 #include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h"
 #include "BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h"
 #include "BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h"
+#include "LinearMath/btThreads.h"
+
+#include <algorithm>
+#include <atomic>
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -216,12 +227,26 @@ class CObjectTracker {
 			}
 		}
 
+		const CUtlVector<CPhysicsObject *> &GetActiveObjectList() const {
+			return m_activeObjects;
+		}
+
 		void SetObjectEventHandler(IPhysicsObjectEvent *pEvents) {
 			m_pObjEvents = pEvents;
 		}
 
 		void ObjectRemoved(CPhysicsObject *pObject) {
-			m_activeObjects.FindAndRemove(pObject);
+			const int index = pObject->GetActiveIndex();
+			if (index == -1) return;
+
+			Assert(m_activeObjects[index] == pObject);
+
+			// Swap remove, then fix up the index of the object that got moved into our slot
+			m_activeObjects.FastRemove(index);
+			if (index < m_activeObjects.Count())
+				m_activeObjects[index]->SetActiveIndex(index);
+
+			pObject->SetActiveIndex(-1);
 		}
 
 		void Tick() {
@@ -268,13 +293,17 @@ class CObjectTracker {
 						case DISABLE_DEACTIVATION:
 						case ACTIVE_TAG:
 							// Don't add the object twice!
-							if (m_activeObjects.Find(pObj) == -1)
-								m_activeObjects.AddToTail(pObj);
+							if (pObj->GetActiveIndex() == -1)
+								pObj->SetActiveIndex(m_activeObjects.AddToTail(pObj));
+
+							// Fluids stop looking at objects once they fall asleep
+							for (int j = 0; j < pObj->GetTouchingFluids().Count(); j++)
+								pObj->GetTouchingFluids()[j]->ObjectWoke(pObj);
 
 							break;
 						case DISABLE_SIMULATION:
 						case ISLAND_SLEEPING:
-							m_activeObjects.FindAndRemove(pObj);
+							ObjectRemoved(pObj);
 							break;
 						default:
 							NOT_IMPLEMENTED;
@@ -290,7 +319,7 @@ class CObjectTracker {
 		CPhysicsEnvironment *m_pEnv;
 		IPhysicsObjectEvent *m_pObjEvents;
 
-		CUtlVector<IPhysicsObject *> m_activeObjects;
+		CUtlVector<CPhysicsObject *> m_activeObjects;
 };
 
 /*******************************
@@ -305,6 +334,12 @@ class CPhysicsCollisionData : public IPhysicsCollisionData {
 			ConvertPosToHL(manPoint->m_lateralFrictionDir1, m_contactSpeed);	// FIXME: Need the correct variable from the manifold point
 		}
 
+		CPhysicsCollisionData(const btVector3 &normal, const btVector3 &point, const btVector3 &speed) {
+			ConvertDirectionToHL(normal, m_surfaceNormal);
+			ConvertPosToHL(point, m_contactPoint);
+			ConvertPosToHL(speed, m_contactSpeed);
+		}
+
 		// normal points toward second object (object index 1)
 		void GetSurfaceNormal(Vector &out) override
 		{
@@ -333,201 +368,556 @@ class CPhysicsCollisionData : public IPhysicsCollisionData {
 * CLASS CCollisionEventListener
 *********************************/
 
+static ConVar cvar_friction_minenergy("bt_friction_minenergy", "0.01", FCVAR_REPLICATED, "Friction energy (in joules per substep) an object pair has to dissipate to start generating friction events, it stops under half of this", true, 0, false, 0);
+static ConVar cvar_friction_interval("bt_friction_interval", "0.05", FCVAR_REPLICATED, "Minimum time between friction events for an object pair. Keep under 0.1, the game fades scrape sounds that don't get updated for that long", true, 0, false, 0);
+
+// Collision events are recorded from inside the solver and handed to the game once the step is done.
+// The solver may be running on several threads, so every thread gets its own buffer and nothing in
+// here touches the bodies or calls into the game until DispatchEvents.
 class CCollisionEventListener : public btSolveCallback {
 	public:
-		CCollisionEventListener(CPhysicsEnvironment *pEnv) {
+		CCollisionEventListener(CPhysicsEnvironment *pEnv) : m_frictionPairs(FrictionPairLessFunc) {
 			m_pEnv = pEnv;
 			m_pCallback = NULL;
+			m_frictionTick = 0;
+			m_flNextImpactPrune = 0;
 		}
 
-		// TODO: Optimize this, heavily!
 		void preSolveContact(btSolverBody *body0, btSolverBody *body1, btManifoldPoint *cp) override
 		{
+			// Everything we need is still around in postSolveContact
+		}
+
+		void postSolveContact(btSolverBody *body0, btSolverBody *body1, btManifoldPoint *cp) override
+		{
+			if (!m_pCallback) return;
+
+			// FIXME: Problem with bullet code, only one solver body created for static objects!
+			// There could be more than one static object created by us!
 			CPhysicsObject *pObj0 = static_cast<CPhysicsObject*>(body0->m_originalColObj->getUserPointer());
 			CPhysicsObject *pObj1 = static_cast<CPhysicsObject*>(body1->m_originalColObj->getUserPointer());
-			if (pObj0->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE || pObj1->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE)
-				return;
+			if (!pObj0 || !pObj1) return;
 
 			const unsigned int flags0 = pObj0->GetCallbackFlags();
 			const unsigned int flags1 = pObj1->GetCallbackFlags();
+			if ((flags0 | flags1) & CALLBACK_MARKED_FOR_DELETE)
+				return;
 
-			// Clear it
-			memset(&m_tmpEvent, 0, sizeof(m_tmpEvent));
-			m_tmpEvent.collisionSpeed = 0.f; // Invalid pre-collision
-			m_tmpEvent.deltaCollisionTime = 10.f; // FIXME: Find a way to track the real delta time
-			m_tmpEvent.isCollision = (flags0 & flags1 & CALLBACK_GLOBAL_COLLISION); // False when either one of the objects don't have CALLBACK_GLOBAL_COLLISION
-			m_tmpEvent.isShadowCollision = ((flags0 ^ flags1) & CALLBACK_SHADOW_COLLISION) != 0; // True when only one of the objects is a shadow (if both are shadow, it's handled by the game)
+			if (!pObj0->IsCollisionEventsEnabled() && !pObj1->IsCollisionEventsEnabled())
+				return;
 
-			m_tmpEvent.pObjects[0] = pObj0;
-			m_tmpEvent.pObjects[1] = pObj1;	
-			m_tmpEvent.surfaceProps[0] = pObj0->GetMaterialIndex();
-			m_tmpEvent.surfaceProps[1] = pObj1->GetMaterialIndex();
+			bool isCollision = (flags0 & flags1 & CALLBACK_GLOBAL_COLLISION) != 0; // False when either one of the objects don't have CALLBACK_GLOBAL_COLLISION
+			const bool isShadowCollision = ((flags0 ^ flags1) & CALLBACK_SHADOW_COLLISION) != 0; // True when only one of the objects is a shadow (if both are shadow, it's handled by the game)
+			if ((pObj0->IsStatic() && !(flags1 & CALLBACK_GLOBAL_COLLIDE_STATIC)) || (pObj1->IsStatic() && !(flags0 & CALLBACK_GLOBAL_COLLIDE_STATIC)))
+				isCollision = false;
+
+			// Drop contacts too soft for the game to care about (sounds, damage) before doing any work on them.
+			// Shadow collisions are few and the game relies on them for touch, so they always go through.
+			if (isCollision && !isShadowCollision) {
+				const btRigidBody *pBody0 = body0->m_originalBody;
+				const btRigidBody *pBody1 = body1->m_originalBody;
+				const btScalar combinedInvMass = (pBody0 ? pBody0->getInvMass() : 0) + (pBody1 ? pBody1->getInvMass() : 0);
+				if (cp->m_appliedImpulse * combinedInvMass < m_pEnv->GetPairMinImpactSpeedBull(pObj0->GetMaterialIndex(), pObj1->GetMaterialIndex()))
+					return;
+			}
 
-			if ((pObj0->IsStatic() && !(flags1 & CALLBACK_GLOBAL_COLLIDE_STATIC)) || (pObj1->IsStatic() && !(flags0 & CALLBACK_GLOBAL_COLLIDE_STATIC))) {
-				m_tmpEvent.isCollision = false;
+			if (!isCollision && !isShadowCollision) return;
+
+			// Object order decides the order events come out in, so it can't depend on which thread solved what
+			const bool swap = pObj0->GetObjectIndex() > pObj1->GetObjectIndex();
+			btSolverBody *pBodies[2] = { swap ? body1 : body0, swap ? body0 : body1 };
+
+			collisionrecord_t record;
+			record.pObjects[0] = swap ? pObj1 : pObj0;
+			record.pObjects[1] = swap ? pObj0 : pObj1;
+			record.isCollision = isCollision;
+			record.isShadowCollision = isShadowCollision;
+			record.normal = swap ? -cp->m_normalWorldOnB : cp->m_normalWorldOnB;
+			record.position = cp->getPositionWorldOnA();
+			record.impulse = cp->m_appliedImpulse;
+			record.combinedInvMass = 0;
+
+			// The solver hasn't written back yet, so the bodies still have their velocities from before the solve
+			for (int i = 0; i < 2; i++) {
+				const btRigidBody *pBody = pBodies[i]->m_originalBody;
+				if (pBody) {
+					record.velocities[i] = pBody->getLinearVelocity();
+					record.angVelocities[i] = pBody->getAngularVelocity();
+					record.deltaVelocities[i] = pBodies[i]->internalGetDeltaLinearVelocity();
+					record.deltaAngVelocities[i] = pBodies[i]->internalGetDeltaAngularVelocity();
+					record.combinedInvMass += pBody->getInvMass();
+				} else {
+					record.velocities[i].setZero();
+					record.angVelocities[i].setZero();
+					record.deltaVelocities[i].setZero();
+					record.deltaAngVelocities[i].setZero();
+				}
 			}
 
-			if (!m_tmpEvent.isCollision && !m_tmpEvent.isShadowCollision) return;
+			m_buffers[btGetCurrentThreadIndex()].AddToTail(record);
+		}
+
+		void friction(btSolverBody *body0, btSolverBody *body1, btSolverConstraint *constraint) override
+		{
+			// Friction events are generated from the manifolds once the step is done, see DispatchFrictionEvents
+		}
 
-			CPhysicsCollisionData data(cp);
-			m_tmpEvent.pInternalData = &data;
+		void SetCollisionEventCallback(IPhysicsCollisionEvent *pCallback) {
+			m_pCallback = pCallback;
+		}
 
-			// Give the game its stupid velocities
-			if (body0->m_originalBody) {
-				m_tmpVelocities[0] = body0->m_originalBody->getLinearVelocity();
-				m_tmpAngVelocities[0] = body0->m_originalBody->getAngularVelocity();
+		// Call on the main thread after a step. Contacts are merged so each object pair gets one
+		// PreCollision/PostCollision per step, carrying the contact with the strongest impulse.
+		void DispatchEvents() {
+			m_events.RemoveAll();
+			for (int i = 0; i < BT_MAX_THREAD_COUNT; i++) {
+				if (m_buffers[i].Count() == 0) continue;
 
-				body0->m_originalBody->setLinearVelocity(m_tmpVelocities[0] + body0->internalGetDeltaLinearVelocity());
-				body0->m_originalBody->setAngularVelocity(m_tmpAngVelocities[0] + body0->internalGetDeltaAngularVelocity());
+				m_events.AddMultipleToTail(m_buffers[i].Count(), m_buffers[i].Base());
+				m_buffers[i].RemoveAll();
 			}
-			if (body1->m_originalBody) {
-				m_tmpVelocities[1] = body1->m_originalBody->getLinearVelocity();
-				m_tmpAngVelocities[1] = body1->m_originalBody->getAngularVelocity();
 
-				body1->m_originalBody->setLinearVelocity(m_tmpVelocities[1] + body1->internalGetDeltaLinearVelocity());
-				body1->m_originalBody->setAngularVelocity(m_tmpAngVelocities[1] + body1->internalGetDeltaAngularVelocity());
+			if (!m_pCallback || m_events.Count() == 0) return;
+
+			m_events.Sort(CompareRecords);
+			PruneImpacts();
+
+			for (int i = 0; i < m_events.Count(); i++) {
+				// Strongest contact of each pair sorts first, skip the rest
+				if (i > 0 && m_events[i].pObjects[0] == m_events[i - 1].pObjects[0] && m_events[i].pObjects[1] == m_events[i - 1].pObjects[1])
+					continue;
+
+				DispatchEvent(m_events[i]);
 			}
+		}
 
-			if (m_pCallback)
-				m_pCallback->PreCollision(&m_tmpEvent);
+		// Call on the main thread after a step. The energy friction dissipated is worked out per manifold in
+		// parallel, then summed per object pair. A pair starts scraping above bt_friction_minenergy and keeps
+		// scraping until it drops under half of that, with Friction called at most every bt_friction_interval.
+		void DispatchFrictionEvents() {
+			if (!m_pCallback) {
+				m_frictionPairs.RemoveAll();
+				return;
+			}
 
-			// Restore the velocities
-			// UNDONE: No need, postSolveContact will do this.
-			/*
-			if (body0->m_originalBody) {
-				body0->m_originalBody->setLinearVelocity(m_tmpVelocities[0]);
-				body0->m_originalBody->setAngularVelocity(m_tmpAngVelocities[0]);
+			btDispatcher *pDispatcher = m_pEnv->GetBulletEnvironment()->getDispatcher();
+			const int numManifolds = pDispatcher->getNumManifolds();
+			if (numManifolds > 0) {
+				CFrictionLoop loop(pDispatcher->getInternalManifoldPointer(), m_frictionBuffers);
+				btParallelFor(0, numManifolds, 64, loop);
 			}
-			if (body1->m_originalBody) {
-				body1->m_originalBody->setLinearVelocity(m_tmpVelocities[1]);
-				body1->m_originalBody->setAngularVelocity(m_tmpAngVelocities[1]);
+
+			m_frictionRecords.RemoveAll();
+			for (int i = 0; i < BT_MAX_THREAD_COUNT; i++) {
+				if (m_frictionBuffers[i].Count() == 0) continue;
+
+				m_frictionRecords.AddMultipleToTail(m_frictionBuffers[i].Count(), m_frictionBuffers[i].Base());
+				m_frictionBuffers[i].RemoveAll();
 			}
-			*/
-		}
 
-		// TODO: Optimize this, heavily!
-		void postSolveContact(btSolverBody *body0, btSolverBody *body1, btManifoldPoint *cp) override
-		{
-			btRigidBody *rb0 = btRigidBody::upcast(body0->m_originalColObj);
-			btRigidBody *rb1 = btRigidBody::upcast(body1->m_originalColObj);
+			m_frictionTick++;
+			m_frictionRecords.Sort(CompareFrictionRecords);
+
+			const btScalar startEnergy = cvar_friction_minenergy.GetFloat();
+			const float interval = cvar_friction_interval.GetFloat();
+			const float simTime = m_pEnv->GetSimulationTime();
+
+			for (int i = 0; i < m_frictionRecords.Count(); ) {
+				// Compounds get a manifold per touching child, fold them into one record per pair.
+				// The strongest manifold sorts first and supplies the contact.
+				const frictionrecord_t &record = m_frictionRecords[i];
+				btScalar energy = 0;
+				for (; i < m_frictionRecords.Count() && m_frictionRecords[i].pObjects[0] == record.pObjects[0] && m_frictionRecords[i].pObjects[1] == record.pObjects[1]; i++)
+					energy += m_frictionRecords[i].energy;
+
+				// By serial, the object pool hands a dead object's block to the next one created
+				const unsigned int serial0 = record.pObjects[0]->GetSerial();
+				const unsigned int serial1 = record.pObjects[1]->GetSerial();
+				frictionpairkey_t key = { { min(serial0, serial1), max(serial0, serial1) } };
+				int index = m_frictionPairs.Find(key);
+				if (index == m_frictionPairs.InvalidIndex()) {
+					// Pairs only start tracking once they could start scraping
+					if (energy < startEnergy) continue;
+
+					frictionpair_t pair;
+					pair.energy = 0;
+					pair.lastFired = -FLT_MAX;
+					pair.numSteps = 0;
+					pair.scraping = false;
+					index = m_frictionPairs.Insert(key, pair);
+				}
 
-			// FIXME: Problem with bullet code, only one solver body created for static objects!
-			// There could be more than one static object created by us!
-			CPhysicsObject *pObj0 = static_cast<CPhysicsObject*>(body0->m_originalColObj->getUserPointer());
-			CPhysicsObject *pObj1 = static_cast<CPhysicsObject*>(body1->m_originalColObj->getUserPointer());
-			if (pObj0->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE || pObj1->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE)
-				return;
+				frictionpair_t &pair = m_frictionPairs[index];
+				pair.tick = m_frictionTick;
 
-			//unsigned int flags0 = pObj0->GetCallbackFlags();
-			//unsigned int flags1 = pObj1->GetCallbackFlags();
+				if (!pair.scraping && energy >= startEnergy) {
+					pair.scraping = true;
+				} else if (pair.scraping && energy < startEnergy * 0.5f) {
+					pair.scraping = false;
+					pair.energy = 0;
+					pair.numSteps = 0;
+				}
 
-			const btScalar combinedInvMass = rb0->getInvMass() + rb1->getInvMass();
-			m_tmpEvent.collisionSpeed = BULL2HL(cp->m_appliedImpulse * combinedInvMass); // Speed of body 1 rel to body 2 on axis of constraint normal
+				if (!pair.scraping) continue;
 
-			// FIXME: Find a way to track the real delta time
-			// IVP tracks this delta time between object pairs
-			m_tmpEvent.deltaCollisionTime = 10.f;
-			/*
-			m_tmpEvent.isCollision = (flags0 & flags1 & CALLBACK_GLOBAL_COLLISION); // False when either one of the objects don't have CALLBACK_GLOBAL_COLLISION
-			m_tmpEvent.isShadowCollision = (flags0 ^ flags1) & CALLBACK_SHADOW_COLLISION; // True when only one of the objects is a shadow
+				pair.energy += energy;
+				pair.numSteps++;
 
-			m_tmpEvent.pObjects[0] = pObj0;
-			m_tmpEvent.pObjects[1] = pObj1;	
-			m_tmpEvent.surfaceProps[0] = pObj0 ? pObj0->GetMaterialIndex() : 0;
-			m_tmpEvent.surfaceProps[1] = pObj1 ? pObj1->GetMaterialIndex() : 0;
-			*/
+				if (simTime - pair.lastFired < interval) continue;
 
-			if (!m_tmpEvent.isCollision && !m_tmpEvent.isShadowCollision) return;
+				// Report the average over the steps we held back, so the energy doesn't depend on the interval
+				DispatchFriction(record, pair.energy / pair.numSteps);
+				pair.energy = 0;
+				pair.numSteps = 0;
+				pair.lastFired = simTime;
+			}
 
-			CPhysicsCollisionData data(cp);
-			m_tmpEvent.pInternalData = &data;
+			// Pairs that stopped touching or sliding this step are done
+			for (int i = m_frictionPairs.FirstInorder(); i != m_frictionPairs.InvalidIndex(); ) {
+				const int next = m_frictionPairs.NextInorder(i);
+				if (m_frictionPairs[i].tick != m_frictionTick)
+					m_frictionPairs.RemoveAt(i);
 
-			// Give the game its stupid velocities
-			if (body0->m_originalBody) {
-				body0->m_originalBody->setLinearVelocity(m_tmpVelocities[0] + body0->internalGetDeltaLinearVelocity());
-				body0->m_originalBody->setAngularVelocity(m_tmpAngVelocities[0] + body0->internalGetDeltaAngularVelocity());
+				i = next;
 			}
-			if (body1->m_originalBody) {
-				body1->m_originalBody->setLinearVelocity(m_tmpVelocities[1] + body1->internalGetDeltaLinearVelocity());
-				body1->m_originalBody->setAngularVelocity(m_tmpAngVelocities[1] + body1->internalGetDeltaAngularVelocity());
+		}
+
+	private:
+		struct frictionrecord_t {
+			CPhysicsObject *	pObjects[2];			// Ordered by object index
+			btVector3			position;
+			btVector3			normal;					// Points toward pObjects[1]
+			btVector3			slideVelocity;			// Of pObjects[1] relative to pObjects[0], along the surface
+			btScalar			energy;					// Dissipated by friction over the step, in joules
+		};
+
+		struct frictionpairkey_t {
+			unsigned int		serials[2];				// CPhysicsObject::GetSerial, lowest first
+		};
+
+		struct frictionpair_t {
+			btScalar			energy;					// Held back since lastFired
+			float				lastFired;
+			int					numSteps;
+			unsigned int		tick;					// Last tick the pair was sliding
+			bool				scraping;
+		};
+
+		// Read only over the manifolds and bodies, every thread appends to its own buffer
+		class CFrictionLoop : public btIParallelForBody {
+			public:
+				CFrictionLoop(btPersistentManifold **pManifolds, CUtlVector<frictionrecord_t> *pBuffers) : m_pManifolds(pManifolds), m_pBuffers(pBuffers) {}
+
+				void forLoop(int iBegin, int iEnd) const override {
+					frictionrecord_t record;
+					for (int i = iBegin; i < iEnd; i++) {
+						if (ComputeFriction(m_pManifolds[i], record))
+							m_pBuffers[btGetCurrentThreadIndex()].AddToTail(record);
+					}
+				}
+
+			private:
+				btPersistentManifold **			m_pManifolds;
+				CUtlVector<frictionrecord_t> *	m_pBuffers;
+		};
+
+		// Sums the work friction did over the step at each contact point, see ComputeFrictionEnergy
+		static bool ComputeFriction(const btPersistentManifold *pManifold, frictionrecord_t &record) {
+			const int numContacts = pManifold->getNumContacts();
+			if (numContacts <= 0) return false;
+
+			const btCollisionObject *pColObj0 = pManifold->getBody0();
+			const btCollisionObject *pColObj1 = pManifold->getBody1();
+
+			// These are our own internal objects, don't do callbacks on them.
+			if (pColObj0->getInternalType() == btCollisionObject::CO_GHOST_OBJECT || pColObj1->getInternalType() == btCollisionObject::CO_GHOST_OBJECT)
+				return false;
+
+			CPhysicsObject *pObj0 = static_cast<CPhysicsObject*>(pColObj0->getUserPointer());
+			CPhysicsObject *pObj1 = static_cast<CPhysicsObject*>(pColObj1->getUserPointer());
+			if (!pObj0 || !pObj1) return false;
+
+			const unsigned int flags0 = pObj0->GetCallbackFlags();
+			const unsigned int flags1 = pObj1->GetCallbackFlags();
+			if (!(flags0 & flags1 & CALLBACK_GLOBAL_FRICTION) || ((flags0 | flags1) & CALLBACK_MARKED_FOR_DELETE))
+				return false;
+
+			btScalar energy = 0;
+			btScalar maxEnergy = 0;
+			int best = 0;
+			btVector3 bestVelocity(0, 0, 0);
+			for (int i = 0; i < numContacts; i++) {
+				btVector3 relVel;
+				const btScalar pointEnergy = ComputeFrictionEnergy(pManifold, pManifold->getContactPoint(i), &relVel);
+				energy += pointEnergy;
+				if (pointEnergy > maxEnergy) {
+					maxEnergy = pointEnergy;
+					best = i;
+					bestVelocity = relVel;
+				}
 			}
 
-			if (m_pCallback)
-				m_pCallback->PostCollision(&m_tmpEvent);
+			if (energy <= SIMD_EPSILON) return false;
 
-			// Restore the velocities
-			if (body0->m_originalBody) {
-				body0->m_originalBody->setLinearVelocity(m_tmpVelocities[0]);
-				body0->m_originalBody->setAngularVelocity(m_tmpAngVelocities[0]);
+			// Same order as the collision events, so which body is 0 doesn't depend on the broadphase
+			const bool swap = pObj0->GetObjectIndex() > pObj1->GetObjectIndex();
+			const btManifoldPoint &cp = pManifold->getContactPoint(best);
+
+			record.pObjects[0] = swap ? pObj1 : pObj0;
+			record.pObjects[1] = swap ? pObj0 : pObj1;
+			record.position = cp.getPositionWorldOnA();
+			record.normal = swap ? -cp.m_normalWorldOnB : cp.m_normalWorldOnB;
+			record.slideVelocity = swap ? -bestVelocity : bestVelocity;
+			record.energy = energy;
+			return true;
+		}
+
+		static int CompareFrictionRecords(const frictionrecord_t *a, const frictionrecord_t *b) {
+			for (int i = 0; i < 2; i++) {
+				const int indexA = a->pObjects[i]->GetObjectIndex();
+				const int indexB = b->pObjects[i]->GetObjectIndex();
+				if (indexA != indexB)
+					return indexA < indexB ? -1 : 1;
 			}
-			if (body1->m_originalBody) {
-				body1->m_originalBody->setLinearVelocity(m_tmpVelocities[1]);
-				body1->m_originalBody->setAngularVelocity(m_tmpAngVelocities[1]);
+
+			if (a->energy != b->energy)
+				return a->energy > b->energy ? -1 : 1;
+
+			return 0;
+		}
+
+		static bool FrictionPairLessFunc(const frictionpairkey_t &a, const frictionpairkey_t &b) {
+			if (a.serials[0] != b.serials[0])
+				return a.serials[0] < b.serials[0];
+
+			return a.serials[1] < b.serials[1];
+		}
+
+		void DispatchFriction(const frictionrecord_t &record, btScalar energy) {
+			// The game may have deleted either one from an earlier event
+			if ((record.pObjects[0]->GetCallbackFlags() | record.pObjects[1]->GetCallbackFlags()) & CALLBACK_MARKED_FOR_DELETE)
+				return;
+
+			// One event per pair like IVP, reported on the moving object (scraping against the world is the usual case)
+			const int self = record.pObjects[0]->IsStatic() ? 1 : 0;
+			CPhysicsObject *pObject = record.pObjects[self];
+			CPhysicsObject *pOther = record.pObjects[!self];
+
+			CPhysicsCollisionData data(record.normal, record.position, record.slideVelocity);
+			m_pCallback->Friction(pObject, ConvertEnergyToHL(energy), pObject->GetMaterialIndex(), pOther->GetMaterialIndex(), &data);
+		}
+
+		struct collisionrecord_t {
+			CPhysicsObject *	pObjects[2];
+			btVector3			velocities[2];			// Before the solve
+			btVector3			angVelocities[2];
+			btVector3			deltaVelocities[2];		// Added by the solve
+			btVector3			deltaAngVelocities[2];
+			btVector3			normal;					// Points toward pObjects[1]
+			btVector3			position;
+			btScalar			impulse;
+			btScalar			combinedInvMass;
+			bool				isCollision;
+			bool				isShadowCollision;
+		};
+
+		static int CompareRecords(const collisionrecord_t *a, const collisionrecord_t *b) {
+			for (int i = 0; i < 2; i++) {
+				const int indexA = a->pObjects[i]->GetObjectIndex();
+				const int indexB = b->pObjects[i]->GetObjectIndex();
+				if (indexA != indexB)
+					return indexA < indexB ? -1 : 1;
 			}
+
+			if (a->impulse != b->impulse)
+				return a->impulse > b->impulse ? -1 : 1;
+
+			return 0;
 		}
 
-		void friction(btSolverBody *body0, btSolverBody *body1, btSolverConstraint *constraint) override
-		{
-			/*
-			btRigidBody *rb0 = btRigidBody::upcast(body0->m_originalColObj);
-			btRigidBody *rb1 = btRigidBody::upcast(body1->m_originalColObj);
+		void DispatchEvent(const collisionrecord_t &record) {
+			CPhysicsObject *pObj0 = record.pObjects[0];
+			CPhysicsObject *pObj1 = record.pObjects[1];
 
-			// FIXME: Problem with bullet code, only one solver body created for static objects!
-			// There could be more than one static object created by us!
-			CPhysicsObject *pObj0 = (CPhysicsObject *)body0->m_originalColObj->getUserPointer();
-			CPhysicsObject *pObj1 = (CPhysicsObject *)body1->m_originalColObj->getUserPointer();
+			// The game may have deleted either one from an earlier event
+			if ((pObj0->GetCallbackFlags() | pObj1->GetCallbackFlags()) & CALLBACK_MARKED_FOR_DELETE)
+				return;
 
-			unsigned int flags0 = pObj0->GetCallbackFlags();
-			unsigned int flags1 = pObj1->GetCallbackFlags();
+			vcollisionevent_t event;
+			memset(&event, 0, sizeof(event));
+			event.pObjects[0] = pObj0;
+			event.pObjects[1] = pObj1;
+			event.surfaceProps[0] = pObj0->GetMaterialIndex();
+			event.surfaceProps[1] = pObj1->GetMaterialIndex();
+			event.isCollision = record.isCollision;
+			event.isShadowCollision = record.isShadowCollision;
+			event.collisionSpeed = 0.f; // Invalid pre-collision
+			event.deltaCollisionTime = UpdateImpactTime(pObj0, pObj1);
+
+			CPhysicsCollisionData data(record.normal, record.position, record.velocities[1] - record.velocities[0]);
+			event.pInternalData = &data;
+
+			btRigidBody *pBodies[2] = { pObj0->GetObject(), pObj1->GetObject() };
+			btVector3 savedVelocities[2], savedAngVelocities[2];
+			for (int i = 0; i < 2; i++) {
+				savedVelocities[i] = pBodies[i]->getLinearVelocity();
+				savedAngVelocities[i] = pBodies[i]->getAngularVelocity();
+			}
 
-			// Don't do the callback if it's disabled on either object
-			if (!(flags0 & flags1 & CALLBACK_GLOBAL_FRICTION)) return;
+			// Give the game its stupid velocities, from before the collision...
+			SetVelocities(pBodies, record.velocities, record.angVelocities);
+			m_pCallback->PreCollision(&event);
 
-			// If the solver uses 2 friction directions
-			btSolverConstraint *constraint2 = NULL;
-			if (m_pEnv->GetBulletEnvironment()->getSolverInfo().m_solverMode & SOLVER_USE_2_FRICTION_DIRECTIONS) {
-				constraint2 = constraint + 1; // Always stored after the first one
+			if ((pObj0->GetCallbackFlags() | pObj1->GetCallbackFlags()) & CALLBACK_MARKED_FOR_DELETE)
+				return;
+
+			// ...and after
+			btVector3 postVelocities[2], postAngVelocities[2];
+			for (int i = 0; i < 2; i++) {
+				postVelocities[i] = record.velocities[i] + record.deltaVelocities[i];
+				postAngVelocities[i] = record.angVelocities[i] + record.deltaAngVelocities[i];
 			}
 
-			// Calculate the energy consumed
-			float totalImpulse = constraint->m_appliedImpulse + (constraint2 ? constraint2->m_appliedImpulse : 0);
-			totalImpulse *= rb0->getInvMass(); // Get just the velocity
-			totalImpulse *= totalImpulse; // Square it
-			totalImpulse *= SAFE_DIVIDE(.5, rb0->getInvMass()); // Add back the mass (1/2*mv^2)
+			event.collisionSpeed = BULL2HL(record.impulse * record.combinedInvMass); // Speed of body 1 rel to body 2 on axis of constraint normal
+			SetVelocities(pBodies, postVelocities, postAngVelocities);
+			m_pCallback->PostCollision(&event);
 
-			if (m_pCallback)
-				m_pCallback->Friction(pObj0)
-			*/
+			// Restore the velocities
+			SetVelocities(pBodies, savedVelocities, savedAngVelocities);
 		}
 
-		void SetCollisionEventCallback(IPhysicsCollisionEvent *pCallback) {
-			m_pCallback = pCallback;
+		// Returns the time since the pair last collided and makes now the last time
+		float UpdateImpactTime(const CPhysicsObject *pObj0, const CPhysicsObject *pObj1) {
+			const unsigned int serial0 = pObj0->GetSerial(), serial1 = pObj1->GetSerial();
+			const uint64 key = serial0 < serial1 ? ((uint64)serial0 << 32) | serial1 : ((uint64)serial1 << 32) | serial0;
+			const float simTime = m_pEnv->GetSimulationTime();
+
+			const UtlHashHandle_t handle = m_lastImpacts.Find(key);
+			if (handle == m_lastImpacts.InvalidHandle()) {
+				m_lastImpacts.Insert(key, simTime);
+				return MAX_DELTA_COLLISION_TIME;
+			}
+
+			const float deltaTime = MIN(simTime - m_lastImpacts.Element(handle), MAX_DELTA_COLLISION_TIME);
+			m_lastImpacts.Element(handle) = simTime;
+			return deltaTime;
+		}
+
+		// Everything we remember is stamped with the simulation time, which would be in the future now
+		void ResetSimulationClock() {
+			m_lastImpacts.RemoveAll();
+			m_flNextImpactPrune = 0;
+			m_frictionPairs.RemoveAll();
+		}
+
+		// Forget pairs that haven't collided for long enough that they'd report the maximum anyways.
+		// Only runs once a second, the table is small and lookups don't care about stale entries.
+		void PruneImpacts() {
+			const float simTime = m_pEnv->GetSimulationTime();
+			if (simTime < m_flNextImpactPrune) return;
+
+			m_flNextImpactPrune = simTime + 1.f;
+
+			m_staleImpacts.RemoveAll();
+			for (UtlHashHandle_t i = m_lastImpacts.FirstHandle(); i != m_lastImpacts.InvalidHandle(); i = m_lastImpacts.NextHandle(i)) {
+				if (simTime - m_lastImpacts.Element(i) >= MAX_DELTA_COLLISION_TIME)
+					m_staleImpacts.AddToTail(m_lastImpacts.Key(i));
+			}
+
+			for (int i = 0; i < m_staleImpacts.Count(); i++)
+				m_lastImpacts.Remove(m_staleImpacts[i]);
+		}
+
+		static void SetVelocities(btRigidBody **pBodies, const btVector3 *velocities, const btVector3 *angVelocities) {
+			for (int i = 0; i < 2; i++) {
+				if (pBodies[i]->getInvMass() == 0) continue;
+
+				pBodies[i]->setLinearVelocity(velocities[i]);
+				pBodies[i]->setAngularVelocity(angVelocities[i]);
+			}
 		}
 
-	private:
 		CPhysicsEnvironment *m_pEnv;
 		IPhysicsCollisionEvent *m_pCallback;
 
-		// Temp. variables saved between Pre/PostCollision
-		btVector3 m_tmpVelocities[2];
-		btVector3 m_tmpAngVelocities[2];
-		vcollisionevent_t m_tmpEvent{};
+		CUtlVector<collisionrecord_t> m_buffers[BT_MAX_THREAD_COUNT];
+		CUtlVector<collisionrecord_t> m_events;
+
+		// What the game gets as deltaCollisionTime for a pair that hasn't collided recently (or ever)
+		static const float MAX_DELTA_COLLISION_TIME;
+
+		// Last collision time per object pair, keyed by both serials (lowest first)
+		CUtlHashtable<uint64, float> m_lastImpacts;
+		CUtlVector<uint64> m_staleImpacts;
+		float m_flNextImpactPrune;
+
+		CUtlVector<frictionrecord_t> m_frictionBuffers[BT_MAX_THREAD_COUNT];
+		CUtlVector<frictionrecord_t> m_frictionRecords;
+		CUtlMap<frictionpairkey_t, frictionpair_t, int> m_frictionPairs;
+		unsigned int m_frictionTick;
 };
 
+const float CCollisionEventListener::MAX_DELTA_COLLISION_TIME = 10.f;
+
+/*******************************
+* Material pair contact callback
+*******************************/
+
+// Installed as gContactAddedCallback. Objects opt in with CF_CUSTOM_MATERIAL_CALLBACK (see CPhysicsObject::Init)
+// Called from the narrowphase (possibly from worker threads), so this must only read shared data.
+static bool MaterialPairContactAdded(btManifoldPoint &cp, const btCollisionObjectWrapper *colObj0Wrap, int partId0, int index0, const btCollisionObjectWrapper *colObj1Wrap, int partId1, int index1) {
+	CPhysicsObject *pObj0 = static_cast<CPhysicsObject*>(colObj0Wrap->getCollisionObject()->getUserPointer());
+	CPhysicsObject *pObj1 = static_cast<CPhysicsObject*>(colObj1Wrap->getCollisionObject()->getUserPointer());
+	if (!pObj0 || !pObj1)
+		return false;
+
+	// Also called when a point replaces an old one in the manifold cache, those keep the old point's lifetime.
+	// Only brand new points count towards maxCollisionsPerObjectPerTimestep.
+	if (cp.getLifeTime() == 0 && pObj0->GetVPhysicsEnvironment()->IsCountingCollisions()) {
+		if (!pObj0->IsStatic()) pObj0->AddCollision();
+		if (!pObj1->IsStatic()) pObj1->AddCollision();
+	}
+
+	const materialpair_t *pPair = g_SurfaceDatabase.GetMaterialPair(pObj0->GetMaterialIndex(), pObj1->GetMaterialIndex());
+	if (!pPair)
+		return false;
+
+	cp.m_combinedFriction = pPair->friction;
+	cp.m_combinedRestitution = pPair->elasticity;
+	return true;
+}
+
+// Installed as gCalculateCombinedRestitutionCallback. Bullet uses it for the restitution it applies to predictive
+// contacts after solving (setApplySpeculativeContactRestitution), normal contacts go through MaterialPairContactAdded.
+static btScalar MaterialPairRestitution(const btCollisionObject *body0, const btCollisionObject *body1) {
+	const CPhysicsObject *pObj0 = static_cast<const CPhysicsObject*>(body0->getUserPointer());
+	const CPhysicsObject *pObj1 = static_cast<const CPhysicsObject*>(body1->getUserPointer());
+
+	const materialpair_t *pPair = pObj0 && pObj1 ? g_SurfaceDatabase.GetMaterialPair(pObj0->GetMaterialIndex(), pObj1->GetMaterialIndex()) : NULL;
+	if (!pPair)
+		return body0->getRestitution() * body1->getRestitution();
+
+	return pPair->elasticity;
+}
+
 /*******************************
 * Bullet Dynamics World Static References
 *******************************/
 
-// TODO: See if this dynamics world pointer is right, it's assigned twice
-static bool gBulletDynamicsWorldGuard = false;
-static btDynamicsWorld* gBulletDynamicsWorld = NULL;
+// Environments apply the new settings at the start of their next step. Goes through every environment
+// g_Physics knows about, so ConVar changes reach all of them and not just the last world created
+static void InvalidateAllWorldSettings()
+{
+	for (int i = 0; i < g_Physics.GetActiveEnvironmentCount(); i++)
+	{
+		((CPhysicsEnvironment *)g_Physics.GetActiveEnvironmentByIndex(i))->InvalidateWorldSettings();
+	}
+}
 
 #ifdef BT_THREADSAFE
 static bool gMultithreadedWorld = true;
-static SolverType gSolverType = SOLVER_TYPE_SEQUENTIAL_IMPULSE_MT;
 #else
 static bool gMultithreadedWorld = false;
-static SolverType gSolverType = SOLVER_TYPE_SEQUENTIAL_IMPULSE;
 #endif
 
 static int gSolverMode = SOLVER_SIMD | SOLVER_USE_WARMSTARTING |
@@ -542,11 +932,8 @@ static void cvar_solver_iterations_Change(IConVar *var, const char *pOldValue, f
 static ConVar cvar_solver_iterations("bt_solver_iterations", "4", FCVAR_REPLICATED, "Number of collision solver iterations", true, 1, true, 32, cvar_solver_iterations_Change);
 static void cvar_solver_iterations_Change(IConVar *var, const char *pOldValue, float flOldValue)
 {
-	if(gBulletDynamicsWorld)
-	{
-		gBulletDynamicsWorld->getSolverInfo().m_numIterations = cvar_solver_iterations.GetInt();
-		Msg("Solver iteration count is changed from %i to %i\n", static_cast<int>(flOldValue), cvar_solver_iterations.GetInt());
-	}
+	InvalidateAllWorldSettings();
+	Msg("Solver iteration count is changed from %i to %i\n", static_cast<int>(flOldValue), cvar_solver_iterations.GetInt());
 }
 
 // bt_solver_residualthreshold
@@ -554,15 +941,247 @@ static void cvar_solver_residualthreshold_Change(IConVar *var, const char *pOldV
 static ConVar cvar_solver_residualthreshold("bt_solver_residualthreshold", "0.0", FCVAR_REPLICATED, "Solver leastSquaresResidualThreshold (used to run fewer solver iterations when convergence is good)", true, 0.0f, true, 0.25f, cvar_solver_residualthreshold_Change);
 static void cvar_solver_residualthreshold_Change(IConVar *var, const char *pOldValue, float flOldValue)
 {
-	if (gBulletDynamicsWorld)
+	InvalidateAllWorldSettings();
+	Msg("Solver residual threshold is changed from %f to %f\n", flOldValue, cvar_solver_residualthreshold.GetFloat());
+}
+
+// bt_solver_type
+static void cvar_solver_type_Change(IConVar *var, const char *pOldValue, float flOldValue);
+static ConVar cvar_solver_type("bt_solver_type", "0", FCVAR_REPLICATED, "Constraint solver backend (0 = sequential impulse, 1 = NNCG, 2 = MLCP PGS, 3 = MLCP Dantzig, 4 = MLCP Lemke)", true, 0, true, PHYSICS_SOLVER_COUNT - 1, cvar_solver_type_Change);
+static void cvar_solver_type_Change(IConVar *var, const char *pOldValue, float flOldValue)
+{
+	InvalidateAllWorldSettings();
+	Msg("Solver type is changed from %i to %i\n", static_cast<int>(flOldValue), cvar_solver_type.GetInt());
+}
+
+// bt_collision_minspeed
+static void cvar_collision_minspeed_Change(IConVar *var, const char *pOldValue, float flOldValue);
+static ConVar cvar_collision_minspeed("bt_collision_minspeed", "0", FCVAR_REPLICATED, "Contacts slower than this (in/s) don't generate collision events. Resting contacts are usually under 10, 0 = no limit", true, 0, false, 0, cvar_collision_minspeed_Change);
+static ConVar cvar_collision_thresholdscale("bt_collision_thresholdscale", "0", FCVAR_REPLICATED, "Scale on the surfaceprops hardVelocityThreshold of a material pair, contacts slower than that don't generate collision events (0 = off)", true, 0, true, 1, cvar_collision_minspeed_Change);
+static void cvar_collision_minspeed_Change(IConVar *var, const char *pOldValue, float flOldValue)
+{
+	InvalidateAllWorldSettings();
+}
+
+// bt_ccd_motionfraction
+static void cvar_ccd_motionfraction_Change(IConVar *var, const char *pOldValue, float flOldValue);
+static ConVar cvar_ccd_motionfraction("bt_ccd_motionfraction", "0.5", FCVAR_REPLICATED, "Objects use CCD on steps where they move further than this fraction of their smallest extent", true, 0, false, 0, cvar_ccd_motionfraction_Change);
+static void cvar_ccd_motionfraction_Change(IConVar *var, const char *pOldValue, float flOldValue)
+{
+	InvalidateAllWorldSettings();
+}
+
+static ConVar cvar_ccd_compound("bt_ccd_compound", "1", FCVAR_REPLICATED, "Sweep fast compound objects against the world ourselves, Bullet's CCD only handles convex shapes");
+
+// bt_ccd_benchmark
+// Fires boxes at a thin wall in a scratch environment, once per CCD mode, and reports the cost and how many got through
+static void CCDBenchmark_f(const CCommand &args)
+{
+	const int count = args.ArgC() > 1 ? clamp(atoi(args[1]), 1, 1024) : 64;
+	const float speed = args.ArgC() > 2 ? max((float)atof(args[2]), 1.f) : 4000.f;
+	const float timestep = 1.f / 66.f;
+	const int numSteps = 66;
+
+	static const physics_ccdmode_t s_modes[] = { PHYSICS_CCD_DISABLED, PHYSICS_CCD_AUTO, PHYSICS_CCD_SPECULATIVE };
+	static const char *s_modeNames[] = { "none", "swept", "speculative" };
+
+	// Not BBoxToCollide, the bbox cache would hand us a shared collide
+	CPhysConvex *pWallConvex = g_PhysicsCollision.BBoxToConvex(Vector(-1, -512, -512), Vector(1, 512, 512));
+	CPhysCollide *pWall = g_PhysicsCollision.ConvertConvexToCollide(&pWallConvex, 1);
+	CPhysConvex *pBoxConvex = g_PhysicsCollision.BBoxToConvex(Vector(-4, -4, -4), Vector(4, 4, 4));
+	CPhysCollide *pBox = g_PhysicsCollision.ConvertConvexToCollide(&pBoxConvex, 1);
+
+	objectparams_t params;
+	memset(&params, 0, sizeof(params));
+	params.mass = 10.f;
+	params.inertia = 1.f;
+	params.rotInertiaLimit = 0.05f;
+	params.pName = "ccd_benchmark";
+	params.enableCollisions = true;
+
+	const int rows = (int)ceil(sqrt((float)count));
+	const Vector velocity(speed, 0, 0);
+
+	Msg("Firing %i boxes at a 2 unit wall at %.0f in/s for %i steps%s\n", count, speed, numSteps, cvar_ccd_compound.GetBool() ? "" : " (bt_ccd_compound is off, swept does nothing)");
+	for (int mode = 0; mode < ARRAYSIZE(s_modes); mode++)
 	{
-		gBulletDynamicsWorld->getSolverInfo().m_leastSquaresResidualThreshold = cvar_solver_residualthreshold.GetFloat();
-		Msg("Solver residual threshold is changed from %f to %f\n", flOldValue, cvar_solver_residualthreshold.GetFloat());
+		CPhysicsEnvironment *pEnv = new CPhysicsEnvironment;
+		pEnv->SetGravity(vec3_origin);
+		pEnv->SetSimulationTimestep(timestep);
+		pEnv->CreatePolyObjectStatic(pWall, 0, vec3_origin, vec3_angle, &params);
+
+		CUtlVector<IPhysicsObject32 *> boxes;
+		for (int i = 0; i < count; i++)
+		{
+			const Vector position(-128, (i % rows - rows / 2) * 16.f, (i / rows - rows / 2) * 16.f);
+			IPhysicsObject32 *pObject = (IPhysicsObject32 *)pEnv->CreatePolyObject(pBox, 0, position, vec3_angle, &params);
+			pObject->SetCCDMode(s_modes[mode]);
+			pObject->SetVelocity(&velocity, NULL);
+			boxes.AddToTail(pObject);
+		}
+
+		// Simulate is only public through the interface
+		IPhysicsEnvironment *pSimulate = pEnv;
+
+		const double startTime = Plat_FloatTime();
+		for (int i = 0; i < numSteps; i++)
+			pSimulate->Simulate(timestep);
+		const double elapsed = Plat_FloatTime() - startTime;
+
+		int tunnelled = 0;
+		for (int i = 0; i < boxes.Count(); i++)
+		{
+			Vector position;
+			boxes[i]->GetPosition(&position, NULL);
+			if (position.x > 0)
+				tunnelled++;
+		}
+
+		Msg("%-12s %7.3f ms/step, %i/%i tunnelled\n", s_modeNames[mode], elapsed * 1000.0 / numSteps, tunnelled, count);
+		delete pEnv;
 	}
+
+	g_PhysicsCollision.DestroyCollide(pWall);
+	g_PhysicsCollision.DestroyCollide(pBox);
 }
 
+static ConCommand cmd_ccdbenchmark("bt_ccd_benchmark", CCDBenchmark_f, "Compare the cost and tunnelling rate of the CCD modes on fast boxes hitting a wall\n\tArguments: [box count] [speed in in/s]", FCVAR_CHEAT);
+
 // bt_substeps
-static ConVar cvar_world_substeps("bt_world_substeps", "1", FCVAR_REPLICATED, "The amount of simulation substeps (higher number means higher precision)", true, 1, true, 8);
+static ConVar cvar_world_substeps("bt_world_substeps", "1", FCVAR_REPLICATED, "The amount of simulation substeps per step (higher number means higher precision)", true, 1, true, 8);
+static ConVar cvar_island_sleep("bt_island_sleep", "1", FCVAR_REPLICATED, "Put whole islands to sleep once their total kinetic energy stays under their objects' sleep thresholds");
+static ConVar cvar_island_sleep_ticks("bt_island_sleep_ticks", "30", FCVAR_REPLICATED, "Substeps an island has to stay under its sleep threshold before bt_island_sleep puts it to sleep", true, 1, false, 0);
+static ConVar cvar_world_maxsteps("bt_world_maxsteps", "4", FCVAR_REPLICATED, "The most steps a single frame may run to catch up, extra time is dropped", true, 1, true, 16);
+
+// bt_solver_adaptive
+static ConVar cvar_solver_adaptive("bt_solver_adaptive", "0", FCVAR_REPLICATED, "Scale solver iterations per island by size and convergence, and back off when steps go over bt_solver_timebudget");
+static ConVar cvar_solver_timebudget("bt_solver_timebudget", "4", FCVAR_REPLICATED, "Time budget for a simulation step in ms, used by bt_solver_adaptive (0 = no budget)", true, 0, false, 0);
+static ConVar cvar_solver_largeisland("bt_solver_largeisland", "64", FCVAR_REPLICATED, "Islands with at least this many contacts and constraints lose iterations first when over budget", true, 1, false, 0);
+static ConVar cvar_solver_adaptive_residual("bt_solver_adaptive_residual", "0.0001", FCVAR_REPLICATED, "Residual at which islands stop iterating early while bt_solver_adaptive is on", true, 0, true, 0.25f);
+
+static const char *s_solverNames[PHYSICS_SOLVER_COUNT] = { "sequential impulse", "NNCG", "MLCP PGS", "MLCP Dantzig", "MLCP Lemke" };
+
+// bt_solver_info
+static void SolverInfo_f(const CCommand &args)
+{
+	for (int i = 0; i < g_Physics.GetActiveEnvironmentCount(); i++)
+	{
+		CPhysicsEnvironment *pEnv = (CPhysicsEnvironment *)g_Physics.GetActiveEnvironmentByIndex(i);
+		Msg("Environment %i: %s solver, %i iterations, %i threads, %i active objects, last step %.3f ms\n", i, s_solverNames[pEnv->GetSolverType()],
+			pEnv->GetSolverIterations(), pEnv->GetThreadBudget(), pEnv->GetActiveObjectCount(), pEnv->GetLastStepTime() * 1000.f);
+	}
+}
+
+static ConCommand cmd_solverinfo("bt_solver_info", SolverInfo_f, "Print the solver backend and the cost of the last step for each environment");
+
+// bt_solver_benchmark
+// Runs a box stack and a hanging chain in a scratch environment, once per solver backend, and reports the cost
+// along with how badly the scene holds together: deepest contact penetration, how far the top of the stack
+// wandered and the largest gap opened up in a chain joint
+static void SolverBenchmark_f(const CCommand &args)
+{
+	const int stackHeight = args.ArgC() > 1 ? clamp(atoi(args[1]), 1, 128) : 16;
+	const int numSteps = args.ArgC() > 2 ? clamp(atoi(args[2]), 1, 6600) : 200;
+	const int numLinks = 12;
+	const float timestep = 1.f / 66.f;
+
+	// Not BBoxToCollide, the bbox cache would hand us a shared collide
+	CPhysConvex *pFloorConvex = g_PhysicsCollision.BBoxToConvex(Vector(-512, -512, -16), Vector(512, 512, 0));
+	CPhysCollide *pFloor = g_PhysicsCollision.ConvertConvexToCollide(&pFloorConvex, 1);
+	CPhysConvex *pBoxConvex = g_PhysicsCollision.BBoxToConvex(Vector(-8, -8, -8), Vector(8, 8, 8));
+	CPhysCollide *pBox = g_PhysicsCollision.ConvertConvexToCollide(&pBoxConvex, 1);
+	// Links are shorter than the joint spacing so neighbours don't collide with each other as the chain bends
+	CPhysConvex *pLinkConvex = g_PhysicsCollision.BBoxToConvex(Vector(-6, -2, -2), Vector(6, 2, 2));
+	CPhysCollide *pLink = g_PhysicsCollision.ConvertConvexToCollide(&pLinkConvex, 1);
+
+	objectparams_t params;
+	memset(&params, 0, sizeof(params));
+	params.mass = 10.f;
+	params.inertia = 1.f;
+	params.rotInertiaLimit = 0.05f;
+	params.pName = "solver_benchmark";
+	params.enableCollisions = true;
+
+	// The chain hangs off a static anchor, starting out horizontal so it has to swing down
+	const Vector anchorPos(256, 0, 512);
+
+	Msg("Simulating a %i box stack and a %i link chain for %i steps\n", stackHeight, numLinks, numSteps);
+	for (int type = 0; type < PHYSICS_SOLVER_COUNT; type++)
+	{
+		CPhysicsEnvironment *pEnv = new CPhysicsEnvironment;
+		pEnv->SetGravity(Vector(0, 0, -600));
+		pEnv->SetSimulationTimestep(timestep);
+		pEnv->SetSolverType((physics_solvertype_t)type);
+		pEnv->CreatePolyObjectStatic(pFloor, 0, vec3_origin, vec3_angle, &params);
+
+		CUtlVector<IPhysicsObject *> stack;
+		for (int i = 0; i < stackHeight; i++)
+		{
+			stack.AddToTail(pEnv->CreatePolyObject(pBox, 0, Vector(0, 0, 8 + i * 16.f), vec3_angle, &params));
+		}
+
+		constraint_ballsocketparams_t ballsocket;
+		ballsocket.Defaults();
+		ballsocket.constraintPosition[0] = Vector(8, 0, 0);
+		ballsocket.constraintPosition[1] = Vector(-8, 0, 0);
+
+		CUtlVector<IPhysicsObject *> chain;
+		chain.AddToTail(pEnv->CreatePolyObjectStatic(pLink, 0, anchorPos, vec3_angle, &params));
+		for (int i = 0; i < numLinks; i++)
+		{
+			IPhysicsObject *pPrev = chain.Tail();
+			IPhysicsObject *pObject = pEnv->CreatePolyObject(pLink, 0, anchorPos + Vector(16 + i * 16.f, 0, 0), vec3_angle, &params);
+
+			pEnv->CreateBallsocketConstraint(pPrev, pObject, NULL, ballsocket);
+			chain.AddToTail(pObject);
+		}
+
+		// Simulate is only public through the interface
+		IPhysicsEnvironment *pSimulate = pEnv;
+		btDispatcher *pDispatcher = pEnv->GetBulletEnvironment()->getDispatcher();
+
+		double elapsed = 0.0;
+		btScalar maxPenetration = 0;
+		float maxJointError = 0.f;
+		for (int step = 0; step < numSteps; step++)
+		{
+			const double startTime = Plat_FloatTime();
+			pSimulate->Simulate(timestep);
+			elapsed += Plat_FloatTime() - startTime;
+
+			for (int i = 0; i < pDispatcher->getNumManifolds(); i++)
+			{
+				const btPersistentManifold *pManifold = pDispatcher->getManifoldByIndexInternal(i);
+				for (int j = 0; j < pManifold->getNumContacts(); j++)
+				{
+					maxPenetration = btMin(maxPenetration, pManifold->getContactPoint(j).getDistance());
+				}
+			}
+
+			for (int i = 1; i < chain.Count(); i++)
+			{
+				Vector prevJoint, joint;
+				chain[i - 1]->LocalToWorld(&prevJoint, ballsocket.constraintPosition[0]);
+				chain[i]->LocalToWorld(&joint, ballsocket.constraintPosition[1]);
+				maxJointError = max(maxJointError, prevJoint.DistTo(joint));
+			}
+		}
+
+		Vector stackTop;
+		stack.Tail()->GetPosition(&stackTop, NULL);
+		const float stackDrift = stackTop.DistTo(Vector(0, 0, 8 + (stackHeight - 1) * 16.f));
+
+		Msg("%-20s %7.3f ms/step, max penetration %.3f in, stack drift %.3f in, max joint error %.3f in\n", s_solverNames[type],
+			elapsed * 1000.0 / numSteps, ConvertDistanceToHL(-maxPenetration), stackDrift, maxJointError);
+		delete pEnv;
+	}
+
+	g_PhysicsCollision.DestroyCollide(pFloor);
+	g_PhysicsCollision.DestroyCollide(pBox);
+	g_PhysicsCollision.DestroyCollide(pLink);
+}
+
+static ConCommand cmd_solverbenchmark("bt_solver_benchmark", SolverBenchmark_f, "Compare the cost and stability of the solver backends on a box stack and a hanging chain\n\tArguments: [stack height] [steps]", FCVAR_CHEAT);
 
 // Threadsafe specific console variables
 #ifdef BT_THREADSAFE
@@ -572,14 +1191,9 @@ static void cvar_threadcount_Change(IConVar *var, const char *pOldValue, float f
 static ConVar cvar_threadcount("bt_threadcount", "1", FCVAR_REPLICATED, "Number of cores utilized by bullet task scheduler. By default, TBB sets this to optimal value", true, 1, true, static_cast<float>(BT_MAX_THREAD_COUNT), cvar_threadcount_Change);
 static void cvar_threadcount_Change(IConVar *var, const char *pOldValue, float flOldValue)
 {
-	const int newNumThreads = min(cvar_threadcount.GetInt(), int(BT_MAX_THREAD_COUNT));
-	const int oldNumThreads = btGetTaskScheduler()->getNumThreads();
-	// only call when the thread count is different
-	if (newNumThreads != oldNumThreads)
-	{
-		btGetTaskScheduler()->setNumThreads(newNumThreads);
-		Msg("Changed %s task scheduler thread count from %i to %i\n", btGetTaskScheduler()->getName(), oldNumThreads, newNumThreads);
-	}
+	// Every environment that hasn't been given its own budget follows the ConVar
+	InvalidateAllWorldSettings();
+	Msg("Task scheduler thread count is changed from %i to %i\n", static_cast<int>(flOldValue), cvar_threadcount.GetInt());
 }
 
 // bt_island_batchingthreshold
@@ -631,12 +1245,32 @@ CPhysicsEnvironment::CPhysicsEnvironment() {
 	m_bUseDeleteQueue	= false;
 	m_inSimulation		= false;
 	m_bConstraintNotify = false;
+	m_bControllerScheduleDirty = true;
+	m_bTickingControllers = false;
+	m_bControllerHoles = false;
 	m_pDebugOverlay		= NULL;
 	m_pConstraintEvent	= NULL;
 	m_pObjectEvent		= NULL;
 	m_pObjectTracker	= NULL;
 	m_pCollisionEvent	= NULL;
 	m_pThreadManager	= NULL;
+	m_pTaskScheduler	= NULL;
+	m_iThreadBudget		= 0;
+	m_iSolverTypeOverride = -1;
+	m_flCollisionMinSpeedOverride = -1.f;
+	m_flCollisionMinSpeed = HL2BULL(cvar_collision_minspeed.GetFloat());
+	m_flCollisionThresholdScale = cvar_collision_thresholdscale.GetFloat();
+	m_flCCDMotionFraction = cvar_ccd_motionfraction.GetFloat();
+	m_flLastStepTime	= 0.f;
+	m_pBulletSolverMt	= NULL;
+	m_pSolverBudget		= new CSolverBudget;
+	m_pObjectPool		= new CPhysicsObjectPool;
+	m_iCollisionChecks	= 0;
+	m_iCollisionCheckLimit = 0;
+	m_iCollisionCheckSerialLimit = UINT_MAX;
+	m_iSolverIterations = 0;
+	m_flResidualThreshold = -1.f;
+	m_bWorldSettingsDirty = false;
 
 	m_pBulletBroadphase		= NULL;
 	m_pBulletConfiguration	= NULL;
@@ -646,17 +1280,24 @@ CPhysicsEnvironment::CPhysicsEnvironment() {
 	m_pBulletSolver			= NULL;
 
 	m_timestep = 0.f;
-	m_invPSIScale = 0.f;
+	m_simTime = 0;
+	m_flAccumulator = 0.f;
 	m_simPSICurrent = 0;
-	m_simPSI = 0;
+	m_numSubSteps = 0;
+	m_curSubStep = 0;
+	m_subStepsPerStep = 1;
+	m_subStepTime = 0.f;
 
 #ifdef BT_THREADSAFE
-	// Initilize task scheduler, we will be using TBB
-	// btSetTaskScheduler(btGetSequentialTaskScheduler()); // Can be used for debugging purposes
-	btSetTaskScheduler(btGetTBBTaskScheduler());
-	const int maxNumThreads = btGetTBBTaskScheduler()->getMaxNumThreads();
-	btGetTBBTaskScheduler()->setNumThreads(maxNumThreads);
-	cvar_threadcount.SetValue(maxNumThreads);
+	// Each environment gets its own TBB arena, sized by bt_threadcount unless overridden with SetThreadBudget
+	static bool s_bThreadCountInitialized = false;
+	m_pTaskScheduler = new CPhysicsTaskScheduler(cvar_threadcount.GetInt(), false);
+	if (!s_bThreadCountInitialized) {
+		// First environment, default the ConVar to all cores like TBB would
+		s_bThreadCountInitialized = true;
+		m_pTaskScheduler->setNumThreads(m_pTaskScheduler->getMaxNumThreads());
+		cvar_threadcount.SetValue(m_pTaskScheduler->getNumThreads());
+	}
 #endif
 	
 	// Create a fresh new dynamics world
@@ -670,17 +1311,21 @@ CPhysicsEnvironment::~CPhysicsEnvironment() {
 	CPhysicsEnvironment::SetQuickDelete(true);
 
 	for (int i = m_objects.Count() - 1; i >= 0; --i) {
-		delete m_objects[i];
+		CPhysicsObjectPool::DestroyObject(static_cast<CPhysicsObject *>(m_objects[i]));
 	}
 
 	m_objects.RemoveAll();
 	CPhysicsEnvironment::CleanupDeleteList();
 
+	// Sticks around until any objects transferred to other environments are gone
+	m_pObjectPool->Release();
+
 	delete m_pDeleteQueue;
 	delete m_pPhysicsDragController;
 
 	delete m_pBulletDynamicsWorld;
 	delete m_pBulletSolver;
+	delete m_pBulletSolverMt;
 	delete m_pBulletBroadphase;
 	delete m_pBulletDispatcher;
 	delete m_pBulletConfiguration;
@@ -689,6 +1334,8 @@ CPhysicsEnvironment::~CPhysicsEnvironment() {
 	// delete m_pCollisionListener;
 	delete m_pCollisionSolver;
 	delete m_pObjectTracker;
+	delete m_pTaskScheduler;
+	delete m_pSolverBudget;
 }
 
 btConstraintSolver* createSolverByType(SolverType t)
@@ -722,23 +1369,348 @@ btConstraintSolver* createSolverByType(SolverType t)
 	return NULL;
 }
 
-void CPhysicsEnvironment::CreateEmptyDynamicsWorld()
-{
-	if(gBulletDynamicsWorldGuard)
+/*******************************
+* Collision check limit
+*******************************/
+
+// Installed as the dispatcher's near callback. Enforces maxCollisionChecksPerTimestep for object vs object pairs,
+// pairs that didn't fit in the budget (see CPhysicsEnvironment::BudgetCollisionChecks) are skipped and may penetrate
+// until the next timestep. Pairs against static objects are always processed so nothing falls through the world.
+static void PerformanceNearCallback(btBroadphasePair &collisionPair, btCollisionDispatcher &dispatcher, const btDispatcherInfo &dispatchInfo) {
+	const btCollisionObject *colObj0 = static_cast<btCollisionObject *>(collisionPair.m_pProxy0->m_clientObject);
+	const btCollisionObject *colObj1 = static_cast<btCollisionObject *>(collisionPair.m_pProxy1->m_clientObject);
+
+	CPhysicsObject *pObj0 = static_cast<CPhysicsObject *>(colObj0->getUserPointer());
+	CPhysicsObject *pObj1 = static_cast<CPhysicsObject *>(colObj1->getUserPointer());
+	if (pObj0 && pObj1 && !pObj0->GetVPhysicsEnvironment()->CanCheckCollision(pObj0, pObj1)) {
+		// Drop the points left over from earlier timesteps, the solver would keep using them otherwise
+		if (collisionPair.m_algorithm) {
+			btManifoldArray manifolds;
+			collisionPair.m_algorithm->getAllContactManifolds(manifolds);
+			for (int i = 0; i < manifolds.size(); i++) {
+				manifolds[i]->clearManifold();
+			}
+		}
+
+		return;
+	}
+
+	btCollisionDispatcher::defaultNearCallback(collisionPair, dispatcher, dispatchInfo);
+}
+
+// Same as btCollisionWorld::performDiscreteCollisionDetection, with the collision check budget worked out
+// once the broadphase pairs for this timestep are known
+static void PerformDiscreteCollisionDetection(btDynamicsWorld *pWorld) {
+	BT_PROFILE("performDiscreteCollisionDetection");
+
+	pWorld->updateAabbs();
+	pWorld->computeOverlappingPairs();
+
+	btOverlappingPairCache *pPairCache = pWorld->getBroadphase()->getOverlappingPairCache();
+	CPhysicsEnvironment *pEnv = static_cast<CPhysicsEnvironment *>(pWorld->getWorldUserInfo());
+	if (pEnv)
+		pEnv->BudgetCollisionChecks(pPairCache);
+
+	btDispatcher *pDispatcher = pWorld->getDispatcher();
 	{
-		gBulletDynamicsWorld = m_pBulletDynamicsWorld;
+		BT_PROFILE("dispatchAllCollisionPairs");
+		if (pDispatcher)
+			pDispatcher->dispatchAllCollisionPairs(pPairCache, pWorld->getDispatchInfo(), pDispatcher);
 	}
-	else
+}
+
+// Bullet only creates predictive contacts for convex shapes, we add our own for compounds.
+// Collision detection also goes through us for maxCollisionChecksPerTimestep.
+class CPhysicsDynamicsWorld : public btDiscreteDynamicsWorld {
+	public:
+		CPhysicsDynamicsWorld(btDispatcher *dispatcher, btBroadphaseInterface *pairCache, btConstraintSolver *constraintSolver, btCollisionConfiguration *collisionConfiguration)
+			: btDiscreteDynamicsWorld(dispatcher, pairCache, constraintSolver, collisionConfiguration) {}
+
+		virtual void performDiscreteCollisionDetection() {
+			PerformDiscreteCollisionDetection(this);
+		}
+
+	protected:
+		virtual void createPredictiveContacts(btScalar timeStep) {
+			btDiscreteDynamicsWorld::createPredictiveContacts(timeStep);
+
+			CPhysicsEnvironment *pEnv = static_cast<CPhysicsEnvironment *>(getWorldUserInfo());
+			if (pEnv)
+				pEnv->CreateSpeculativeContacts(m_predictiveManifolds, timeStep);
+		}
+};
+
+#ifdef BT_THREADSAFE
+// Lets us swap the solver used for large islands when the solver backend changes
+class CPhysicsDynamicsWorldMt : public btDiscreteDynamicsWorldMt {
+	public:
+		CPhysicsDynamicsWorldMt(btDispatcher *dispatcher, btBroadphaseInterface *pairCache, btConstraintSolverPoolMt *solverPool, btConstraintSolver *constraintSolverMt, btCollisionConfiguration *collisionConfiguration)
+			: btDiscreteDynamicsWorldMt(dispatcher, pairCache, solverPool, constraintSolverMt, collisionConfiguration) {}
+
+		void SetConstraintSolverMt(btConstraintSolver *solver) { m_constraintSolverMt = solver; }
+
+		virtual void performDiscreteCollisionDetection() {
+			PerformDiscreteCollisionDetection(this);
+		}
+
+	protected:
+		// Same as CPhysicsDynamicsWorld, ours run on the main thread after the parallel ones
+		virtual void createPredictiveContacts(btScalar timeStep) {
+			btDiscreteDynamicsWorldMt::createPredictiveContacts(timeStep);
+
+			CPhysicsEnvironment *pEnv = static_cast<CPhysicsEnvironment *>(getWorldUserInfo());
+			if (pEnv)
+				pEnv->CreateSpeculativeContacts(m_predictiveManifolds, timeStep);
+		}
+};
+#endif
+
+static SolverType SolverTypeFromIndex(int type, bool multithreaded)
+{
+	switch (type)
 	{
-		gBulletDynamicsWorldGuard = true;
+		case PHYSICS_SOLVER_NNCG:
+			return SOLVER_TYPE_NNCG;
+		case PHYSICS_SOLVER_MLCP_PGS:
+			return SOLVER_TYPE_MLCP_PGS;
+		case PHYSICS_SOLVER_MLCP_DANTZIG:
+			return SOLVER_TYPE_MLCP_DANTZIG;
+		case PHYSICS_SOLVER_MLCP_LEMKE:
+			return SOLVER_TYPE_MLCP_LEMKE;
+		default:
+			return multithreaded ? SOLVER_TYPE_SEQUENTIAL_IMPULSE_MT : SOLVER_TYPE_SEQUENTIAL_IMPULSE;
+	}
+}
+
+/*******************************
+* CLASS CSolverBudget
+*******************************/
+
+// Shared by all of an environment's solvers. Settings are written between steps and only read during the solve,
+// the counters are bumped from whatever thread is solving an island.
+class CSolverBudget {
+	public:
+		CSolverBudget() {
+			m_bEnabled = false;
+			m_flLoadScale = 1.f;
+			m_iLargeIsland = 64;
+			m_flResidualThreshold = 0.f;
+			Clear();
+		}
+
+		void Clear() {
+			m_islandsSolved = 0;
+			m_islandsReduced = 0;
+			m_iterationsBudgeted = 0;
+			m_iterationsSaved = 0;
+		}
+
+		// Huge islands (usually debris piles) lose iterations first, small ones only once we're far over budget
+		int GetIslandIterations(int iterations, int islandSize) const {
+			if (m_flLoadScale >= 1.f) return iterations;
+
+			float scale = m_flLoadScale;
+			if (islandSize >= m_iLargeIsland) {
+				scale *= sqrtf((float)m_iLargeIsland / islandSize);
+			} else {
+				scale = min(scale * 2.f, 1.f);
+			}
+
+			return max((int)(iterations * scale + 0.5f), 1);
+		}
+
+		bool				m_bEnabled;
+		float				m_flLoadScale;
+		int					m_iLargeIsland;
+		float				m_flResidualThreshold;
+
+		std::atomic<int>	m_islandsSolved;
+		std::atomic<int>	m_islandsReduced;
+		std::atomic<int>	m_iterationsBudgeted;
+		std::atomic<int>	m_iterationsSaved;
+};
+
+/*******************************
+* CLASS CAdaptiveSolver
+*******************************/
+
+// Small islands get batched together before they reach the solver. Their bodies stay grouped by island though.
+static int CountIslands(btCollisionObject **bodies, int numBodies) {
+	int numIslands = 0;
+	int lastTag = -1;
+	for (int i = 0; i < numBodies; i++) {
+		const int tag = bodies[i]->getIslandTag();
+		if (tag >= 0 && tag != lastTag) {
+			numIslands++;
+			lastTag = tag;
+		}
+	}
+
+	return numIslands;
+}
+
+// Static objects have no island, so go by whichever side is dynamic
+static int GetIslandTag(const btCollisionObject *pObj0, const btCollisionObject *pObj1) {
+	return pObj0->getIslandTag() >= 0 ? pObj0->getIslandTag() : pObj1->getIslandTag();
+}
+
+struct IslandBodyLess {
+	bool operator()(const btCollisionObject *a, const btCollisionObject *b) const {
+		return a->getIslandTag() < b->getIslandTag();
+	}
+};
+
+struct IslandManifoldLess {
+	bool operator()(const btPersistentManifold *a, const btPersistentManifold *b) const {
+		return GetIslandTag(a->getBody0(), a->getBody1()) < GetIslandTag(b->getBody0(), b->getBody1());
+	}
+};
+
+struct IslandConstraintLess {
+	bool operator()(const btTypedConstraint *a, const btTypedConstraint *b) const {
+		return GetIslandTag(&a->getRigidBodyA(), &a->getRigidBodyB()) < GetIslandTag(&b->getRigidBodyA(), &b->getRigidBodyB());
+	}
+};
+
+// Wraps one of bullet's solvers and picks the iteration count per island
+class CAdaptiveSolver : public btConstraintSolver {
+	public:
+		CAdaptiveSolver(btConstraintSolver *pSolver, CSolverBudget *pBudget) : m_pSolver(pSolver), m_pBudget(pBudget) {}
+		~CAdaptiveSolver() { delete m_pSolver; }
+
+		void prepareSolve(int numBodies, int numManifolds) override {
+			m_pSolver->prepareSolve(numBodies, numManifolds);
+		}
+
+		btScalar solveGroup(btCollisionObject **bodies, int numBodies, btPersistentManifold **manifold, int numManifolds, btTypedConstraint **constraints, int numConstraints, const btContactSolverInfo &info, btIDebugDraw *debugDrawer, btDispatcher *dispatcher) override {
+			if (!m_pBudget->m_bEnabled) {
+				const int numIslands = CountIslands(bodies, numBodies);
+				m_pBudget->m_islandsSolved += numIslands;
+				m_pBudget->m_iterationsBudgeted += info.m_numIterations * numIslands;
+				return m_pSolver->solveGroup(bodies, numBodies, manifold, numManifolds, constraints, numConstraints, info, debugDrawer, dispatcher);
+			}
+
+			// The batch is a mix of islands, split it back up so every island gets an iteration count for its own size
+			m_bodies.resize(0);
+			m_manifolds.resize(0);
+			m_constraints.resize(0);
+			for (int i = 0; i < numBodies; i++) m_bodies.push_back(bodies[i]);
+			for (int i = 0; i < numManifolds; i++) m_manifolds.push_back(manifold[i]);
+			for (int i = 0; i < numConstraints; i++) m_constraints.push_back(constraints[i]);
+
+			m_bodies.quickSort(IslandBodyLess());
+			m_manifolds.quickSort(IslandManifoldLess());
+			m_constraints.quickSort(IslandConstraintLess());
+
+			btScalar residual = 0;
+			int body = 0, man = 0, con = 0;
+			while (body < numBodies || man < numManifolds || con < numConstraints) {
+				int tag = INT_MAX;
+				if (body < numBodies) tag = min(tag, m_bodies[body]->getIslandTag());
+				if (man < numManifolds) tag = min(tag, GetIslandTag(m_manifolds[man]->getBody0(), m_manifolds[man]->getBody1()));
+				if (con < numConstraints) tag = min(tag, GetIslandTag(&m_constraints[con]->getRigidBodyA(), &m_constraints[con]->getRigidBodyB()));
+
+				const int firstBody = body, firstMan = man, firstCon = con;
+				while (body < numBodies && m_bodies[body]->getIslandTag() == tag) body++;
+				while (man < numManifolds && GetIslandTag(m_manifolds[man]->getBody0(), m_manifolds[man]->getBody1()) == tag) man++;
+				while (con < numConstraints && GetIslandTag(&m_constraints[con]->getRigidBodyA(), &m_constraints[con]->getRigidBodyB()) == tag) con++;
+
+				residual = btMax(residual, SolveIsland(body > firstBody ? &m_bodies[firstBody] : NULL, body - firstBody,
+					man > firstMan ? &m_manifolds[firstMan] : NULL, man - firstMan,
+					con > firstCon ? &m_constraints[firstCon] : NULL, con - firstCon, info, debugDrawer, dispatcher));
+			}
+
+			return residual;
+		}
+
+		void allSolved(const btContactSolverInfo &info, btIDebugDraw *debugDrawer) override {
+			m_pSolver->allSolved(info, debugDrawer);
+		}
+
+		void reset() override {
+			m_pSolver->reset();
+		}
+
+		btConstraintSolverType getSolverType() const override {
+			return m_pSolver->getSolverType();
+		}
+
+	private:
+		btScalar SolveIsland(btCollisionObject **bodies, int numBodies, btPersistentManifold **manifold, int numManifolds, btTypedConstraint **constraints, int numConstraints, const btContactSolverInfo &info, btIDebugDraw *debugDrawer, btDispatcher *dispatcher) {
+			btContactSolverInfo islandInfo = info;
+			islandInfo.m_numIterations = m_pBudget->GetIslandIterations(info.m_numIterations, numManifolds + numConstraints);
+			islandInfo.m_leastSquaresResidualThreshold = max(info.m_leastSquaresResidualThreshold, m_pBudget->m_flResidualThreshold);
+
+			m_pBudget->m_islandsSolved++;
+			m_pBudget->m_iterationsBudgeted += islandInfo.m_numIterations;
+			if (islandInfo.m_numIterations < info.m_numIterations) {
+				m_pBudget->m_islandsReduced++;
+				m_pBudget->m_iterationsSaved += info.m_numIterations - islandInfo.m_numIterations;
+			}
+
+			return m_pSolver->solveGroup(bodies, numBodies, manifold, numManifolds, constraints, numConstraints, islandInfo, debugDrawer, dispatcher);
+		}
+
+		btConstraintSolver *	m_pSolver;
+		CSolverBudget *			m_pBudget;
+
+		// Scratch space for splitting batches, pool solvers are only ever used by one thread at a time
+		btAlignedObjectArray<btCollisionObject *>	m_bodies;
+		btAlignedObjectArray<btPersistentManifold *>m_manifolds;
+		btAlignedObjectArray<btTypedConstraint *>	m_constraints;
+};
+
+btConstraintSolver *CPhysicsEnvironment::CreateSolver(SolverType type) {
+	btConstraintSolver *pSolver = createSolverByType(type);
+	pSolver->setSolveCallback(m_pCollisionListener);
+
+	btConstraintSolver *pAdaptive = new CAdaptiveSolver(pSolver, m_pSolverBudget);
+	pAdaptive->setSolveCallback(m_pCollisionListener);
+	return pAdaptive;
+}
+
+// Called before every step, backs off iterations while steps are going over the time budget
+void CPhysicsEnvironment::UpdateSolverBudget() {
+	CSolverBudget &budget = *m_pSolverBudget;
+	budget.m_bEnabled = cvar_solver_adaptive.GetBool();
+	budget.m_iLargeIsland = cvar_solver_largeisland.GetInt();
+	budget.m_flResidualThreshold = cvar_solver_adaptive_residual.GetFloat();
+
+	const float timeBudget = cvar_solver_timebudget.GetFloat() / 1000.f;
+	if (!budget.m_bEnabled || timeBudget <= 0.f) {
+		budget.m_flLoadScale = 1.f;
+	} else if (m_flLastStepTime > timeBudget) {
+		budget.m_flLoadScale = max(budget.m_flLoadScale * 0.75f, 0.1f);
+	} else if (m_flLastStepTime < timeBudget * 0.5f) {
+		budget.m_flLoadScale = min(budget.m_flLoadScale * 1.1f, 1.f);
 	}
+}
+
+void CPhysicsEnvironment::ReadSolverStats(physics_solverstats_t *pOutput) const {
+	if (!pOutput) return;
 
+	pOutput->islandsSolved = m_pSolverBudget->m_islandsSolved;
+	pOutput->islandsReduced = m_pSolverBudget->m_islandsReduced;
+	pOutput->iterationsBudgeted = m_pSolverBudget->m_iterationsBudgeted;
+	pOutput->iterationsSaved = m_pSolverBudget->m_iterationsSaved;
+	pOutput->loadScale = m_pSolverBudget->m_flLoadScale;
+	pOutput->lastStepTime = m_flLastStepTime;
+}
+
+void CPhysicsEnvironment::ReadIslandStats(physics_islandstats_t *pOutput) const {
+	if (!pOutput) return;
+
+	*pOutput = m_islandStats;
+}
+
+void CPhysicsEnvironment::CreateEmptyDynamicsWorld()
+{
 	m_pCollisionListener = new CCollisionEventListener(this);
 	
-	m_solverType = gSolverType;
+	m_solverType = SolverTypeFromIndex(cvar_solver_type.GetInt(), gMultithreadedWorld);
 #ifdef BT_THREADSAFE
-	btAssert(btGetTaskScheduler() != NULL);
-	if (btGetTaskScheduler() != NULL && btGetTaskScheduler()->getNumThreads() > 1)
+	btAssert(m_pTaskScheduler != NULL);
+	if (m_pTaskScheduler->getNumThreads() > 1)
 	{
 		m_multithreadCapable = true;
 	}
@@ -746,7 +1718,7 @@ void CPhysicsEnvironment::CreateEmptyDynamicsWorld()
 	if (gMultithreadedWorld)
 	{
 #ifdef BT_THREADSAFE
-		btAssert(btGetTaskScheduler() != NULL);
+		btAssert(m_pTaskScheduler != NULL);
 
 		m_pBulletDispatcher = NULL;
 		btDefaultCollisionConstructionInfo cci;
@@ -755,44 +1727,21 @@ void CPhysicsEnvironment::CreateEmptyDynamicsWorld()
 		m_pBulletConfiguration = new btDefaultCollisionConfiguration(cci);
 
 		// Dispatcher generates around 360 pair objects on average. Maximize thread usage by using this value
-		m_pBulletDispatcher = new btCollisionDispatcherMt(m_pBulletConfiguration, 360 / cvar_threadcount.GetInt() + 1);
+		m_pBulletDispatcher = new btCollisionDispatcherMt(m_pBulletConfiguration, 360 / m_pTaskScheduler->getNumThreads() + 1);
 		m_pBulletBroadphase = new btDbvtBroadphase();
 
 		// Enable deferred collide, increases performance with many collisions calculations going on at the same time
 		static_cast<btDbvtBroadphase*>(m_pBulletBroadphase)->m_deferedcollide = true;
 
-		btConstraintSolverPoolMt* solverPool;
-		{
-			SolverType poolSolverType = m_solverType;
-			if (poolSolverType == SOLVER_TYPE_SEQUENTIAL_IMPULSE_MT)
-			{
-				// pool solvers shouldn't be parallel solvers, we don't allow that kind of
-				// nested parallelism because of performance issues
-				poolSolverType = SOLVER_TYPE_SEQUENTIAL_IMPULSE;
-			}
-			CUtlVector<btConstraintSolver*> solvers;
-			const int threadCount = cvar_threadcount.GetInt();
-			for (int i = 0; i < threadCount; ++i)
-			{
-				auto solver = createSolverByType(poolSolverType);
-				solver->setSolveCallback(m_pCollisionListener);
-				solvers.AddToTail(solver);
-			}
-			solverPool = new btConstraintSolverPoolMt(solvers.Base(), threadCount);
-			m_pBulletSolver = solverPool;
-			
-			m_pBulletSolver->setSolveCallback(m_pCollisionListener);
-		}
-		btSequentialImpulseConstraintSolverMt* solverMt = NULL;
-		if (m_solverType == SOLVER_TYPE_SEQUENTIAL_IMPULSE_MT)
-		{
-			solverMt = new btSequentialImpulseConstraintSolverMt();
-		}
-		btDiscreteDynamicsWorld* world = new btDiscreteDynamicsWorldMt(m_pBulletDispatcher, m_pBulletBroadphase, solverPool, solverMt, m_pBulletConfiguration);
+		btConstraintSolverPoolMt* solverPool = CreateSolverPool(m_pTaskScheduler->getNumThreads());
+		m_pBulletSolver = solverPool;
+		// Large islands get the parallel solver, but only while we're using sequential impulse
+		m_pBulletSolverMt = CreateSolver(SOLVER_TYPE_SEQUENTIAL_IMPULSE_MT);
+		btConstraintSolver* solverMt = m_solverType == SOLVER_TYPE_SEQUENTIAL_IMPULSE_MT ? m_pBulletSolverMt : NULL;
+
+		btDiscreteDynamicsWorld* world = new CPhysicsDynamicsWorldMt(m_pBulletDispatcher, m_pBulletBroadphase, solverPool, solverMt, m_pBulletConfiguration);
 		m_pBulletDynamicsWorld = world;
 		m_pBulletDynamicsWorld->setForceUpdateAllAabbs(false);
-		
-		gBulletDynamicsWorld = world; // Also keep a static ref for ConVar callbacks
 		m_multithreadedWorld = true;
 #endif  // #if BT_THREADSAFE
 	}
@@ -809,47 +1758,217 @@ void CPhysicsEnvironment::CreateEmptyDynamicsWorld()
 
 		m_pBulletBroadphase = new btDbvtBroadphase();
 
-		SolverType solverType = m_solverType;
-		if (solverType == SOLVER_TYPE_SEQUENTIAL_IMPULSE_MT)
-		{
-			// using the parallel solver with the single-threaded world works, but is
-			// disabled here to avoid confusion
-			solverType = SOLVER_TYPE_SEQUENTIAL_IMPULSE;
-		}
-		m_pBulletSolver = createSolverByType(solverType);
-		m_pBulletSolver->setSolveCallback(m_pCollisionListener);
+		SolverType solverType = m_solverType;
+		if (solverType == SOLVER_TYPE_SEQUENTIAL_IMPULSE_MT)
+		{
+			// using the parallel solver with the single-threaded world works, but is
+			// disabled here to avoid confusion
+			solverType = SOLVER_TYPE_SEQUENTIAL_IMPULSE;
+		}
+		m_pBulletSolver = CreateSolver(solverType);
+
+		m_pBulletDynamicsWorld = new CPhysicsDynamicsWorld(m_pBulletDispatcher, m_pBulletBroadphase, m_pBulletSolver, m_pBulletConfiguration);
+	}
+	m_pBulletDynamicsWorld->getSolverInfo().m_solverMode = gSolverMode;
+	m_pBulletDynamicsWorld->getSolverInfo().m_numIterations = cvar_solver_iterations.GetInt();
+	m_pBulletDynamicsWorld->getSolverInfo().m_leastSquaresResidualThreshold = cvar_solver_residualthreshold.GetFloat();
+	
+	m_pBulletGhostCallback = new btGhostPairCallback;
+	m_pCollisionSolver = new CCollisionSolver(this);
+	m_pBulletDynamicsWorld->getPairCache()->setOverlapFilterCallback(m_pCollisionSolver);
+	m_pBulletBroadphase->getOverlappingPairCache()->setInternalGhostPairCallback(m_pBulletGhostCallback);
+
+	m_pDeleteQueue = new CDeleteQueue;
+	m_pPhysicsDragController = new CPhysicsDragController;
+	m_pObjectTracker = new CObjectTracker(this, NULL);
+
+	m_perfparams.Defaults();
+	memset(&m_stats, 0, sizeof(m_stats));
+	memset(&m_islandStats, 0, sizeof(m_islandStats));
+
+	// TODO: Threads solve any oversized batches (>32?), otherwise solving done on main thread.
+	m_pBulletDynamicsWorld->getSolverInfo().m_minimumSolverBatchSize = 128; // Combine islands up to this many constraints
+	m_pBulletDynamicsWorld->getDispatchInfo().m_allowedCcdPenetration = 0.0001f;
+	m_pBulletDynamicsWorld->setApplySpeculativeContactRestitution(true);
+
+	m_pBulletDynamicsWorld->setInternalTickCallback(TickCallback, (void *)this);
+	m_pBulletDispatcher->setNearCallback(PerformanceNearCallback);
+
+	// Per surface pair friction/elasticity
+	gContactAddedCallback = MaterialPairContactAdded;
+	gCalculateCombinedRestitutionCallback = MaterialPairRestitution;
+
+#if DEBUG_DRAW
+	m_debugdraw = new CDebugDrawer(m_pBulletDynamicsWorld);
+#endif
+
+	// HACK: Get ourselves a debug overlay on the client
+	CreateInterfaceFn engine = Sys_GetFactory("engine");
+	CPhysicsEnvironment::SetDebugOverlay(engine);
+}
+
+#ifdef BT_THREADSAFE
+// One pool solver per thread in our arena
+btConstraintSolverPoolMt *CPhysicsEnvironment::CreateSolverPool(int threadCount)
+{
+	SolverType poolSolverType = m_solverType;
+	if (poolSolverType == SOLVER_TYPE_SEQUENTIAL_IMPULSE_MT)
+	{
+		// pool solvers shouldn't be parallel solvers, we don't allow that kind of
+		// nested parallelism because of performance issues
+		poolSolverType = SOLVER_TYPE_SEQUENTIAL_IMPULSE;
+	}
+	CUtlVector<btConstraintSolver*> solvers;
+	for (int i = 0; i < threadCount; ++i)
+	{
+		solvers.AddToTail(CreateSolver(poolSolverType));
+	}
+	btConstraintSolverPoolMt *solverPool = new btConstraintSolverPoolMt(solvers.Base(), threadCount);
+	solverPool->setSolveCallback(m_pCollisionListener);
+	return solverPool;
+}
+#endif
+
+void CPhysicsEnvironment::SetThreadBudget(int numThreads, bool highPriority) {
+	// <= 0 goes back to following bt_threadcount
+	m_iThreadBudget = max(numThreads, 0);
+	m_bWorldSettingsDirty = true;
+
+#ifdef BT_THREADSAFE
+	m_pTaskScheduler->SetHighPriority(highPriority);
+#endif
+}
+
+int CPhysicsEnvironment::GetThreadBudget() const {
+#ifdef BT_THREADSAFE
+	return m_pTaskScheduler->getNumThreads();
+#else
+	return 1;
+#endif
+}
+
+void CPhysicsEnvironment::SetSolverIterations(int iterations) {
+	// <= 0 goes back to following bt_solver_iterations
+	m_iSolverIterations = max(iterations, 0);
+	m_bWorldSettingsDirty = true;
+}
+
+int CPhysicsEnvironment::GetSolverIterations() const {
+	return m_pBulletDynamicsWorld->getSolverInfo().m_numIterations;
+}
+
+void CPhysicsEnvironment::SetSolverResidualThreshold(float threshold) {
+	// < 0 goes back to following bt_solver_residualthreshold
+	m_flResidualThreshold = threshold;
+	m_bWorldSettingsDirty = true;
+}
+
+float CPhysicsEnvironment::GetSolverResidualThreshold() const {
+	return m_pBulletDynamicsWorld->getSolverInfo().m_leastSquaresResidualThreshold;
+}
+
+void CPhysicsEnvironment::SetCollisionEventMinSpeed(float speed) {
+	// < 0 goes back to following bt_collision_minspeed
+	m_flCollisionMinSpeedOverride = speed;
+	m_bWorldSettingsDirty = true;
+}
+
+float CPhysicsEnvironment::GetCollisionEventMinSpeed() const {
+	return BULL2HL(m_flCollisionMinSpeed);
+}
+
+// UNEXPOSED
+float CPhysicsEnvironment::GetPairMinImpactSpeedBull(int materialIndex0, int materialIndex1) const {
+	const materialpair_t *pPair = g_SurfaceDatabase.GetMaterialPair(materialIndex0, materialIndex1);
+	if (!pPair)
+		return m_flCollisionMinSpeed;
+
+	return max(m_flCollisionMinSpeed, pPair->minCollisionSpeed * m_flCollisionThresholdScale);
+}
+
+// Called at a step boundary whenever a world ConVar or one of our overrides changed
+void CPhysicsEnvironment::ApplyWorldSettings() {
+	Assert(!m_inSimulation);
+	m_bWorldSettingsDirty = false;
+
+	btContactSolverInfo &info = m_pBulletDynamicsWorld->getSolverInfo();
+	info.m_numIterations = m_iSolverIterations > 0 ? m_iSolverIterations : cvar_solver_iterations.GetInt();
+	info.m_leastSquaresResidualThreshold = m_flResidualThreshold >= 0.f ? m_flResidualThreshold : cvar_solver_residualthreshold.GetFloat();
+
+	// Groups with a solver hint scale off of our iteration count
+	for (int i = 0; i < m_constraintGroups.Count(); i++) {
+		m_constraintGroups[i]->UpdateSolverIterations();
+	}
+
+	ApplySolverType(SolverTypeFromIndex(m_iSolverTypeOverride >= 0 ? m_iSolverTypeOverride : cvar_solver_type.GetInt(), m_multithreadedWorld));
+
+	m_flCollisionMinSpeed = HL2BULL(m_flCollisionMinSpeedOverride >= 0.f ? m_flCollisionMinSpeedOverride : cvar_collision_minspeed.GetFloat());
+	m_flCollisionThresholdScale = cvar_collision_thresholdscale.GetFloat();
+
+	if (m_flCCDMotionFraction != cvar_ccd_motionfraction.GetFloat()) {
+		m_flCCDMotionFraction = cvar_ccd_motionfraction.GetFloat();
+		for (int i = 0; i < m_objects.Count(); i++)
+			static_cast<CPhysicsObject *>(m_objects[i])->UpdateCCD();
+	}
+
+#ifdef BT_THREADSAFE
+	ApplyThreadBudget(m_iThreadBudget > 0 ? m_iThreadBudget : cvar_threadcount.GetInt());
+#endif
+}
+
+// Swaps out the constraint solver (and pool) for a different backend. Only safe between steps.
+void CPhysicsEnvironment::ApplySolverType(SolverType type) {
+	if (type == m_solverType) return;
+	m_solverType = type;
 
-		m_pBulletDynamicsWorld = new btDiscreteDynamicsWorld(m_pBulletDispatcher, m_pBulletBroadphase, m_pBulletSolver, m_pBulletConfiguration);
+	btConstraintSolver *pOldSolver = m_pBulletSolver;
+	if (m_multithreadedWorld) {
+#ifdef BT_THREADSAFE
+		m_pBulletSolver = CreateSolverPool(m_pTaskScheduler->getNumThreads());
+		static_cast<CPhysicsDynamicsWorldMt *>(m_pBulletDynamicsWorld)->SetConstraintSolverMt(type == SOLVER_TYPE_SEQUENTIAL_IMPULSE_MT ? m_pBulletSolverMt : NULL);
+#endif
+	} else {
+		m_pBulletSolver = CreateSolver(type == SOLVER_TYPE_SEQUENTIAL_IMPULSE_MT ? SOLVER_TYPE_SEQUENTIAL_IMPULSE : type);
 	}
-	m_pBulletDynamicsWorld->getSolverInfo().m_solverMode = gSolverMode;
-	m_pBulletDynamicsWorld->getSolverInfo().m_numIterations = cvar_solver_iterations.GetInt();
-	
-	m_pBulletGhostCallback = new btGhostPairCallback;
-	m_pCollisionSolver = new CCollisionSolver(this);
-	m_pBulletDynamicsWorld->getPairCache()->setOverlapFilterCallback(m_pCollisionSolver);
-	m_pBulletBroadphase->getOverlappingPairCache()->setInternalGhostPairCallback(m_pBulletGhostCallback);
 
-	m_pDeleteQueue = new CDeleteQueue;
-	m_pPhysicsDragController = new CPhysicsDragController;
-	m_pObjectTracker = new CObjectTracker(this, NULL);
+	m_pBulletDynamicsWorld->setConstraintSolver(m_pBulletSolver);
+	delete pOldSolver;
+}
 
-	m_perfparams.Defaults();
-	memset(&m_stats, 0, sizeof(m_stats));
+void CPhysicsEnvironment::SetSolverType(physics_solvertype_t type) {
+	m_iSolverTypeOverride = clamp((int)type, 0, PHYSICS_SOLVER_COUNT - 1);
+	m_bWorldSettingsDirty = true;
+}
 
-	// TODO: Threads solve any oversized batches (>32?), otherwise solving done on main thread.
-	m_pBulletDynamicsWorld->getSolverInfo().m_minimumSolverBatchSize = 128; // Combine islands up to this many constraints
-	m_pBulletDynamicsWorld->getDispatchInfo().m_allowedCcdPenetration = 0.0001f;
-	m_pBulletDynamicsWorld->setApplySpeculativeContactRestitution(true);
+physics_solvertype_t CPhysicsEnvironment::GetSolverType() const {
+	switch (m_solverType) {
+		case SOLVER_TYPE_NNCG:
+			return PHYSICS_SOLVER_NNCG;
+		case SOLVER_TYPE_MLCP_PGS:
+			return PHYSICS_SOLVER_MLCP_PGS;
+		case SOLVER_TYPE_MLCP_DANTZIG:
+			return PHYSICS_SOLVER_MLCP_DANTZIG;
+		case SOLVER_TYPE_MLCP_LEMKE:
+			return PHYSICS_SOLVER_MLCP_LEMKE;
+		default:
+			return PHYSICS_SOLVER_SEQUENTIAL_IMPULSE;
+	}
+}
 
-	m_pBulletDynamicsWorld->setInternalTickCallback(TickCallback, (void *)this);
+// Resizes our arena, and the solver pool along with it so every worker has a solver to grab
+void CPhysicsEnvironment::ApplyThreadBudget(int numThreads) {
+#ifdef BT_THREADSAFE
+	const int oldNumThreads = m_pTaskScheduler->getNumThreads();
+	m_pTaskScheduler->setNumThreads(numThreads);
+	m_multithreadCapable = m_pTaskScheduler->getNumThreads() > 1;
 
-#if DEBUG_DRAW
-	m_debugdraw = new CDebugDrawer(m_pBulletDynamicsWorld);
-#endif
+	if (!m_multithreadedWorld || m_pTaskScheduler->getNumThreads() == oldNumThreads) return;
 
-	// HACK: Get ourselves a debug overlay on the client
-	CreateInterfaceFn engine = Sys_GetFactory("engine");
-	CPhysicsEnvironment::SetDebugOverlay(engine);
+	btConstraintSolver *solverPool = m_pBulletSolver;
+	m_pBulletSolver = CreateSolverPool(m_pTaskScheduler->getNumThreads());
+	m_pBulletDynamicsWorld->setConstraintSolver(m_pBulletSolver);
+	delete solverPool;
+#endif
 }
 
 // Don't call this directly
@@ -904,37 +2023,87 @@ float CPhysicsEnvironment::GetAirDensity() const {
 }
 
 IPhysicsObject *CPhysicsEnvironment::CreatePolyObject(const CPhysCollide *pCollisionModel, int materialIndex, const Vector &position, const QAngle &angles, objectparams_t *pParams) {
-	IPhysicsObject *pObject = CreatePhysicsObject(this, pCollisionModel, materialIndex, position, angles, pParams, false);
-	m_objects.AddToTail(pObject);
+	CPhysicsObject *pObject = CreatePhysicsObject(this, pCollisionModel, materialIndex, position, angles, pParams, false);
+	if (pObject)
+		AddObject(pObject);
 	return pObject;
 }
 
 IPhysicsObject *CPhysicsEnvironment::CreatePolyObjectStatic(const CPhysCollide *pCollisionModel, int materialIndex, const Vector &position, const QAngle &angles, objectparams_t *pParams) {
-	IPhysicsObject *pObject = CreatePhysicsObject(this, pCollisionModel, materialIndex, position, angles, pParams, true);
-	m_objects.AddToTail(pObject);
+	CPhysicsObject *pObject = CreatePhysicsObject(this, pCollisionModel, materialIndex, position, angles, pParams, true);
+	if (pObject)
+		AddObject(pObject);
 	return pObject;
 }
 
 // Deprecated. Create a sphere model using collision interface.
 IPhysicsObject *CPhysicsEnvironment::CreateSphereObject(float radius, int materialIndex, const Vector &position, const QAngle &angles, objectparams_t *pParams, bool isStatic) {
-	IPhysicsObject *pObject = CreatePhysicsSphere(this, radius, materialIndex, position, angles, pParams, isStatic);
-	m_objects.AddToTail(pObject);
+	CPhysicsObject *pObject = CreatePhysicsSphere(this, radius, materialIndex, position, angles, pParams, isStatic);
+	if (pObject)
+		AddObject(pObject);
 	return pObject;
 }
 
+// UNEXPOSED
+void CPhysicsEnvironment::AddObject(CPhysicsObject *pObject) {
+	pObject->SetObjectIndex(m_objects.AddToTail(pObject));
+}
+
+// UNEXPOSED
+void CPhysicsEnvironment::RemoveObject(CPhysicsObject *pObject) {
+	const int index = pObject->GetObjectIndex();
+	if (index == -1) return;
+
+	Assert(m_objects[index] == pObject);
+
+	// Swap remove, then fix up the index of the object that got moved into our slot
+	m_objects.FastRemove(index);
+	if (index < m_objects.Count())
+		static_cast<CPhysicsObject *>(m_objects[index])->SetObjectIndex(index);
+
+	pObject->SetObjectIndex(-1);
+}
+
+// UNEXPOSED
+void CPhysicsEnvironment::AddController(IController *pController) {
+	pController->SetControllerIndex(m_controllers.AddToTail(pController));
+	m_bControllerScheduleDirty = true;
+}
+
+// UNEXPOSED
+void CPhysicsEnvironment::RemoveController(IController *pController) {
+	const int index = pController->GetControllerIndex();
+	if (index == -1) return;
+
+	Assert(m_controllers[index] == pController);
+
+	if (m_bTickingControllers) {
+		// Swapping now could move a controller the serial lane hasn't run yet behind it, TickControllers compacts after
+		m_controllers[index] = NULL;
+		m_bControllerHoles = true;
+	} else {
+		m_controllers.FastRemove(index);
+		if (index < m_controllers.Count())
+			m_controllers[index]->SetControllerIndex(index);
+	}
+
+	pController->SetControllerIndex(-1);
+	m_bControllerScheduleDirty = true;
+}
+
 void CPhysicsEnvironment::DestroyObject(IPhysicsObject *pObject) {
 	if (!pObject) return;
 	Assert(m_deadObjects.Find(pObject) == -1);	// If you hit this assert, the object is already on the list!
 
-	m_objects.FindAndRemove(pObject);
-	m_pObjectTracker->ObjectRemoved(dynamic_cast<CPhysicsObject*>(pObject));
+	RemoveObject(static_cast<CPhysicsObject*>(pObject));
+	m_pObjectTracker->ObjectRemoved(static_cast<CPhysicsObject*>(pObject));
 
 	if (m_inSimulation || m_bUseDeleteQueue) {
 		// We're still in the simulation, so deleting an object would be disastrous here. Queue it!
 		dynamic_cast<CPhysicsObject*>(pObject)->AddCallbackFlags(CALLBACK_MARKED_FOR_DELETE);
 		m_deadObjects.AddToTail(pObject);
 	} else {
-		delete pObject;
+		CPhysicsObjectPool::DestroyObject(static_cast<CPhysicsObject*>(pObject));
 	}
 }
 
@@ -1036,17 +2205,24 @@ void CPhysicsEnvironment::DestroyConstraint(IPhysicsConstraint *pConstraint) {
 }
 
 IPhysicsConstraintGroup *CPhysicsEnvironment::CreateConstraintGroup(const constraint_groupparams_t &groupParams) {
-	return ::CreateConstraintGroup(this, groupParams);
+	CPhysicsConstraintGroup *pGroup = ::CreateConstraintGroup(this, groupParams);
+	if (pGroup)
+		m_constraintGroups.AddToTail(pGroup);
+
+	return pGroup;
 }
 
 void CPhysicsEnvironment::DestroyConstraintGroup(IPhysicsConstraintGroup *pGroup) {
+	if (!pGroup) return;
+
+	m_constraintGroups.FindAndRemove((CPhysicsConstraintGroup *)pGroup);
 	delete pGroup;
 }
 
 IPhysicsShadowController *CPhysicsEnvironment::CreateShadowController(IPhysicsObject *pObject, bool allowTranslation, bool allowRotation) {
 	CShadowController *pController = ::CreateShadowController(pObject, allowTranslation, allowRotation);
 	if (pController)
-		m_controllers.AddToTail(pController);
+		AddController(pController);
 
 	return pController;
 }
@@ -1054,14 +2230,14 @@ IPhysicsShadowController *CPhysicsEnvironment::CreateShadowController(IPhysicsOb
 void CPhysicsEnvironment::DestroyShadowController(IPhysicsShadowController *pController) {
 	if (!pController) return;
 
-	m_controllers.FindAndRemove(static_cast<CShadowController*>(pController));
+	RemoveController(static_cast<CShadowController*>(pController));
 	delete pController;
 }
 
 IPhysicsPlayerController *CPhysicsEnvironment::CreatePlayerController(IPhysicsObject *pObject) {
 	CPlayerController *pController = ::CreatePlayerController(this, pObject);
 	if (pController)
-		m_controllers.AddToTail(pController);
+		AddController(pController);
 
 	return pController;
 }
@@ -1069,14 +2245,14 @@ IPhysicsPlayerController *CPhysicsEnvironment::CreatePlayerController(IPhysicsOb
 void CPhysicsEnvironment::DestroyPlayerController(IPhysicsPlayerController *pController) {
 	if (!pController) return;
 
-	m_controllers.FindAndRemove(dynamic_cast<CPlayerController*>(pController));
+	RemoveController(static_cast<CPlayerController*>(pController));
 	delete pController;
 }
 
 IPhysicsMotionController *CPhysicsEnvironment::CreateMotionController(IMotionEvent *pHandler) {
 	CPhysicsMotionController *pController = dynamic_cast<CPhysicsMotionController*>(::CreateMotionController(this, pHandler));
 	if (pController)
-		m_controllers.AddToTail(pController);
+		AddController(pController);
 
 	return pController;
 }
@@ -1084,7 +2260,7 @@ IPhysicsMotionController *CPhysicsEnvironment::CreateMotionController(IMotionEve
 void CPhysicsEnvironment::DestroyMotionController(IPhysicsMotionController *pController) {
 	if (!pController) return;
 
-	m_controllers.FindAndRemove(static_cast<CPhysicsMotionController*>(pController));
+	RemoveController(static_cast<CPhysicsMotionController*>(pController));
 	delete pController;
 }
 
@@ -1114,26 +2290,63 @@ void CPhysicsEnvironment::Simulate(float deltaTime) {
 		deltaTime = 0.1f;
 	}
 
-	// sim PSI: How many substeps are done in a single simulation step
-	m_simPSI = cvar_world_substeps.GetInt() != 0 ? cvar_world_substeps.GetInt() : 1;
-	m_simPSICurrent = m_simPSI; // Substeps left in this step
-	m_numSubSteps = m_simPSI;
+	// Pick up ConVar changes and overrides between steps, never mid step
+	if (m_bWorldSettingsDirty)
+		ApplyWorldSettings();
+
+	// Fixed timestep accumulator:
+	// The game sends in deltaTime which is the amount of time that has passed since the last frame.
+	// We add it to our accumulator and run as many fixed m_timestep steps as fit (up to bt_world_maxsteps),
+	// each split into bt_world_substeps substeps. Controllers pick how often they run with GetSchedule().
+	// Whatever is left over is used by GetInterpolatedPosition so the client can render in between steps.
+	// Frames that don't complete a step don't touch the world at all.
+	m_flAccumulator += deltaTime;
+
+	int numSteps = 0;
+	if (m_timestep > 0.f) {
+		// Tolerate a bit of float error so a frame of exactly m_timestep always steps
+		numSteps = (int)(m_flAccumulator / m_timestep + 0.001f);
+		m_flAccumulator = max(m_flAccumulator - numSteps * m_timestep, 0.f);
+	}
+
+	// Drop time we can't catch up on instead of spiraling
+	numSteps = min(numSteps, cvar_world_maxsteps.GetInt());
+
+	m_subStepsPerStep = max(cvar_world_substeps.GetInt(), 1);
+	m_numSubSteps = numSteps * m_subStepsPerStep;
+	m_simPSICurrent = m_numSubSteps;
 	m_curSubStep = 0;
-	
-	// Simulate no less than 1 ms
-	if (deltaTime > 0.0001) {
+
+	if (numSteps > 0) {
 		// Now mark us as being in simulation. This is used for callbacks from bullet mid-simulation
 		// so we don't end up doing stupid things like deleting objects still in use
 		m_inSimulation = true;
 
-		m_subStepTime = m_timestep;
-		
-		// Okay, how this fixed timestep shit works:
-		// The game sends in deltaTime which is the amount of time that has passed since the last frame
-		// Bullet will add the deltaTime to its internal counter
-		// When this internal counter exceeds m_timestep (param 3 to the below), the simulation will run for fixedTimeStep seconds
-		// If the internal counter does not exceed fixedTimeStep, bullet will just interpolate objects so the game can render them nice and happy
-		m_pBulletDynamicsWorld->stepSimulation(deltaTime, cvar_world_substeps.GetInt(), m_timestep, m_simPSICurrent);
+		m_subStepTime = m_timestep / m_subStepsPerStep;
+
+#ifdef BT_THREADSAFE
+		// Bullet only knows about one scheduler, swap ours in so the step runs in our own arena
+		btITaskScheduler *pPrevScheduler = btGetTaskScheduler();
+		btSetTaskScheduler(m_pTaskScheduler);
+#endif
+
+		UpdateSolverBudget();
+
+		m_iCollisionChecks = 0;
+		m_iCollisionCheckLimit = m_perfparams.maxCollisionChecksPerTimestep > 0 ? m_perfparams.maxCollisionChecksPerTimestep : INT_MAX;
+
+		const double startTime = Plat_FloatTime();
+		for (int i = 0; i < m_numSubSteps; i++) {
+			// maxSubSteps of 0 makes bullet do exactly one step of m_subStepTime, we do the accumulating
+			m_pBulletDynamicsWorld->stepSimulation(m_subStepTime, 0, m_subStepTime, m_simPSICurrent);
+			m_simTime += m_subStepTime;
+		}
+		// Per step, a frame catching up on several steps isn't over the budget for one
+		m_flLastStepTime = (float)(Plat_FloatTime() - startTime) / numSteps;
+
+#ifdef BT_THREADSAFE
+		btSetTaskScheduler(pPrevScheduler);
+#endif
 
 		// No longer in simulation!
 		m_inSimulation = false;
@@ -1156,23 +2369,24 @@ void CPhysicsEnvironment::SetSimulationTimestep(float timestep) {
 	m_timestep = timestep;
 }
 
+// Time simulated since the clock was reset, in whole timesteps
 float CPhysicsEnvironment::GetSimulationTime() const {
-	NOT_IMPLEMENTED
-	return 0;
+	return (float)m_simTime;
 }
 
 void CPhysicsEnvironment::ResetSimulationClock() {
-	NOT_IMPLEMENTED
+	m_simTime = 0;
+	m_flAccumulator = 0.f;
+	m_pCollisionListener->ResetSimulationClock();
 }
 
+// Simulation time once the next step has run
 float CPhysicsEnvironment::GetNextFrameTime() const {
-	NOT_IMPLEMENTED
-	return 0;
+	return (float)(m_simTime + m_timestep);
 }
 
 void CPhysicsEnvironment::SetCollisionEventHandler(IPhysicsCollisionEvent *pCollisionEvents) {
-	// TODO
-	// m_pCollisionListener->SetCollisionEventCallback(pCollisionEvents);
+	m_pCollisionListener->SetCollisionEventCallback(pCollisionEvents);
 	m_pCollisionEvent = pCollisionEvents;
 }
 
@@ -1215,13 +2429,14 @@ bool CPhysicsEnvironment::TransferObject(IPhysicsObject *pObject, IPhysicsEnviro
 
 	if (pDestinationEnvironment == this) {
 		dynamic_cast<CPhysicsObject*>(pObject)->TransferToEnvironment(this);
-		m_objects.AddToTail(pObject);
+		AddObject(static_cast<CPhysicsObject*>(pObject));
 		if (pObject->IsFluid())
 			m_fluids.AddToTail(dynamic_cast<CPhysicsObject*>(pObject)->GetFluidController());
 
 		return true;
 	} else {
-		m_objects.FindAndRemove(pObject);
+		RemoveObject(static_cast<CPhysicsObject*>(pObject));
+		m_pObjectTracker->ObjectRemoved(static_cast<CPhysicsObject*>(pObject));
 		if (pObject->IsFluid())
 			m_fluids.FindAndRemove(dynamic_cast<CPhysicsObject*>(pObject)->GetFluidController());
 
@@ -1231,7 +2446,7 @@ bool CPhysicsEnvironment::TransferObject(IPhysicsObject *pObject, IPhysicsEnviro
 
 void CPhysicsEnvironment::CleanupDeleteList() {
 	for (int i = 0; i < m_deadObjects.Count(); i++) {
-		delete m_deadObjects.Element(i);
+		CPhysicsObjectPool::DestroyObject(static_cast<CPhysicsObject*>(m_deadObjects.Element(i)));
 	}
 
 	m_deadObjects.Purge();
@@ -1260,19 +2475,9 @@ void CPhysicsEnvironment::PostRestore() {
 	NOT_IMPLEMENTED
 }
 
+// Counts objects in every environment, including ones still waiting in the delete queue
 bool CPhysicsEnvironment::IsCollisionModelUsed(CPhysCollide *pCollide) const {
-	for (int i = 0; i < m_objects.Count(); i++) {
-		if (dynamic_cast<CPhysicsObject*>(m_objects[i])->GetObject()->getCollisionShape() == pCollide->GetCollisionShape())
-			return true;
-	}
-
-	// Also scan the to-be-deleted objects list
-	for (int i = 0; i < m_deadObjects.Count(); i++) {
-		if (dynamic_cast<CPhysicsObject*>(m_deadObjects[i])->GetObject()->getCollisionShape() == pCollide->GetCollisionShape())
-			return true;
-	}
-
-	return false;
+	return pCollide->GetObjectRefs() > 0;
 }
 
 void CPhysicsEnvironment::TraceRay(const Ray_t &ray, unsigned int fMask, IPhysicsTraceFilter *pTraceFilter, trace_t *pTrace) {
@@ -1370,6 +2575,12 @@ void CPhysicsEnvironment::ReadStats(physics_stats_t *pOutput) {
 
 void CPhysicsEnvironment::ClearStats() {
 	memset(&m_stats, 0, sizeof(m_stats));
+	m_pSolverBudget->Clear();
+
+	m_islandStats.islandsSlept = 0;
+	m_islandStats.islandsWoken = 0;
+	m_islandStats.objectsSlept = 0;
+	m_islandStats.objectsWoken = 0;
 }
 
 unsigned int CPhysicsEnvironment::GetObjectSerializeSize(IPhysicsObject *pObject) const {
@@ -1402,26 +2613,27 @@ btDiscreteDynamicsWorld *CPhysicsEnvironment::GetBulletEnvironment() const
 	return m_pBulletDynamicsWorld;
 }
 
-// UNEXPOSED
-float CPhysicsEnvironment::GetInvPSIScale() const
-{
-	return m_invPSIScale;
-}
-
 // UNEXPOSED
 void CPhysicsEnvironment::BulletTick(btScalar dt) {
-	// Dirty hack to spread the controllers throughout the current simulation step
-	if (m_simPSICurrent) {
-		m_invPSIScale = 1.0f / static_cast<float>(m_simPSICurrent);
+	// Before anything looks at where objects ended up this step
+	if (cvar_ccd_compound.GetBool())
+		SweepCompoundObjects(dt);
+
+	EnforcePerformanceLimits();
+
+	// Safe to call into the game now, anything it deletes goes through the delete queue
+	m_pCollisionListener->DispatchEvents();
+	m_pCollisionListener->DispatchFrictionEvents();
+	UpdateTriggers();
+
+	UpdateIslandSleep();
+
+	if (m_simPSICurrent)
 		m_simPSICurrent--;
-	} else {
-		m_invPSIScale = 0;
-	}
 
 	m_pPhysicsDragController->Tick(dt);
 
-	for (int i = 0; i < m_controllers.Count(); i++)
-		m_controllers[i]->Tick(dt);
+	TickControllers(dt);
 
 	for (int i = 0; i < m_fluids.Count(); i++)
 		m_fluids[i]->Tick(dt);
@@ -1435,8 +2647,6 @@ void CPhysicsEnvironment::BulletTick(btScalar dt) {
 		CleanupDeleteList();
 	}
 
-	// DoCollisionEvents(dt);
-
 	if (m_pCollisionEvent)
 		m_pCollisionEvent->PostSimulationFrame();
 
@@ -1444,6 +2654,482 @@ void CPhysicsEnvironment::BulletTick(btScalar dt) {
 	m_curSubStep++;
 }
 
+// Closest static or kinematic object in the way of a compound object's center of mass, see SweepCompoundObjects
+class CCompoundSweepCallback : public btCollisionWorld::ClosestConvexResultCallback {
+	public:
+		CCompoundSweepCallback(const CCollisionSolver *pSolver, btRigidBody *pBody, const btVector3 &from, const btVector3 &to) : btCollisionWorld::ClosestConvexResultCallback(from, to) {
+			m_pSolver = pSolver;
+			m_pBody = pBody;
+			m_collisionFilterGroup = pBody->getBroadphaseHandle()->m_collisionFilterGroup;
+			m_collisionFilterMask = pBody->getBroadphaseHandle()->m_collisionFilterMask;
+		}
+
+		virtual bool needsCollision(btBroadphaseProxy *proxy0) const {
+			if (!btCollisionWorld::ClosestConvexResultCallback::needsCollision(proxy0)) return false;
+
+			// Other moving objects will have moved too by the time we'd hit them, let the solver sort those out
+			const btCollisionObject *pOther = static_cast<btCollisionObject *>(proxy0->m_clientObject);
+			if (pOther == m_pBody || !pOther->isStaticOrKinematicObject() || !pOther->hasContactResponse()) return false;
+
+			// Same rules as the broadphase
+			const btRigidBody *pOtherBody = btRigidBody::upcast(pOther);
+			if (!pOtherBody) return false;
+
+			return m_pSolver->NeedsCollision(static_cast<CPhysicsObject *>(m_pBody->getUserPointer()), static_cast<CPhysicsObject *>(pOtherBody->getUserPointer()));
+		}
+
+		virtual btScalar addSingleResult(btCollisionWorld::LocalConvexResult &convexResult, bool normalInWorldSpace) {
+			// Ignore things we're already moving away from
+			const btVector3 normal = normalInWorldSpace ? convexResult.m_hitNormalLocal : convexResult.m_hitCollisionObject->getWorldTransform().getBasis() * convexResult.m_hitNormalLocal;
+			if (normal.dot(m_convexToWorld - m_convexFromWorld) >= 0) return 1;
+
+			return btCollisionWorld::ClosestConvexResultCallback::addSingleResult(convexResult, normalInWorldSpace);
+		}
+
+	private:
+		const CCollisionSolver *m_pSolver;
+		btRigidBody *m_pBody;
+};
+
+// UNEXPOSED
+// Purpose: Bullet's CCD only sweeps convex shapes (see btDiscreteDynamicsWorld::integrateTransforms), and pretty much
+// every prop is a compound. Do the same thing for those: sweep the object's CCD sphere along this step's motion and
+// pull it back to the first static or kinematic object in the way. Only objects that went over their CCD threshold
+// this step get swept, see CPhysicsObject::UpdateCCD.
+void CPhysicsEnvironment::SweepCompoundObjects(btScalar dt) {
+	const CUtlVector<CPhysicsObject *> &activeObjects = m_pObjectTracker->GetActiveObjectList();
+	for (int i = 0; i < activeObjects.Count(); i++) {
+		// Speculative contacts already stopped these before the step
+		if (activeObjects[i]->IsCCDSpeculative()) continue;
+
+		btRigidBody *pBody = activeObjects[i]->GetObject();
+		if (!pBody->getCollisionShape()->isCompound() || pBody->isStaticOrKinematicObject() || !pBody->isActive()) continue;
+
+		const btScalar threshold = pBody->getCcdSquareMotionThreshold();
+		if (threshold == 0) continue;
+
+		// Integration already moved us, this is where we came from
+		const btVector3 motion = pBody->getLinearVelocity() * dt;
+		if (motion.length2() <= threshold) continue;
+
+		btTransform to = pBody->getCenterOfMassTransform();
+		btTransform from = to;
+		from.setOrigin(to.getOrigin() - motion);
+
+		btSphereShape sphere(pBody->getCcdSweptSphereRadius());
+		CCompoundSweepCallback callback(m_pCollisionSolver, pBody, from.getOrigin(), to.getOrigin());
+		m_pBulletDynamicsWorld->convexSweepTest(&sphere, from, to, callback, m_pBulletDynamicsWorld->getDispatchInfo().m_allowedCcdPenetration);
+
+		if (callback.hasHit() && callback.m_closestHitFraction < 1) {
+			to.setOrigin(from.getOrigin() + motion * callback.m_closestHitFraction);
+			pBody->setCenterOfMassTransform(to);
+		}
+	}
+}
+
+// UNEXPOSED
+// Purpose: Speculative contacts for compound objects in PHYSICS_CCD_SPECULATIVE, the same thing Bullet does for convex
+// shapes in btDiscreteDynamicsWorld::createPredictiveContacts. Before the step, sweep the object's CCD sphere along
+// its predicted motion and put a contact with a positive distance wherever it would hit. The solver only lets the
+// object close that distance this step, so it stops at the surface instead of passing through, and Bullet applies
+// restitution to these after solving (setApplySpeculativeContactRestitution).
+void CPhysicsEnvironment::CreateSpeculativeContacts(btAlignedObjectArray<btPersistentManifold *> &manifolds, btScalar dt) {
+	const CUtlVector<CPhysicsObject *> &activeObjects = m_pObjectTracker->GetActiveObjectList();
+	for (int i = 0; i < activeObjects.Count(); i++) {
+		CPhysicsObject *pObject = activeObjects[i];
+		if (!pObject->IsCCDSpeculative()) continue;
+
+		btRigidBody *pBody = pObject->GetObject();
+		if (!pBody->getCollisionShape()->isCompound() || pBody->isStaticOrKinematicObject() || !pBody->isActive()) continue;
+
+		const btScalar threshold = pBody->getCcdSquareMotionThreshold();
+		if (threshold == 0) continue;
+
+		btTransform to;
+		pBody->predictIntegratedTransform(dt, to);
+
+		const btTransform &from = pBody->getWorldTransform();
+		const btVector3 motion = to.getOrigin() - from.getOrigin();
+		if (motion.length2() <= threshold) continue;
+
+		// Sweep without the rotation, like Bullet does
+		to.setBasis(from.getBasis());
+
+		btSphereShape sphere(pBody->getCcdSweptSphereRadius());
+		CCompoundSweepCallback callback(m_pCollisionSolver, pBody, from.getOrigin(), to.getOrigin());
+		m_pBulletDynamicsWorld->convexSweepTest(&sphere, from, to, callback, m_pBulletDynamicsWorld->getDispatchInfo().m_allowedCcdPenetration);
+
+		if (!callback.hasHit() || callback.m_closestHitFraction >= 1) continue;
+
+		const btCollisionObject *pHit = callback.m_hitCollisionObject;
+		const btVector3 distVec = motion * callback.m_closestHitFraction;
+
+		// Contact at the surface point the sweep hit, not at our center of mass, so the solver gets the lever arm
+		// right. On our side it's the point that will be there once we've moved distVec.
+		const btVector3 &pointOnB = callback.m_hitPointWorld;
+		const btVector3 pointOnA = pointOnB - distVec;
+
+		btPersistentManifold *pManifold = m_pBulletDispatcher->getNewManifold(pBody, pHit);
+		manifolds.push_back(pManifold);
+
+		btManifoldPoint newPoint(from.invXform(pointOnA), pHit->getWorldTransform().invXform(pointOnB), callback.m_hitNormalWorld, distVec.dot(-callback.m_hitNormalWorld));
+		btManifoldPoint &point = pManifold->getContactPoint(pManifold->addManifoldPoint(newPoint, true));
+		point.m_positionWorldOnA = pointOnA;
+		point.m_positionWorldOnB = pointOnB;
+
+		// The solver must not bounce us off a surface we haven't reached yet. Bullet applies the pair's elasticity
+		// once the contact was actually hit, after solving (see MaterialPairRestitution)
+		const CPhysicsObject *pOther = static_cast<const CPhysicsObject *>(pHit->getUserPointer());
+		const materialpair_t *pPair = pOther ? g_SurfaceDatabase.GetMaterialPair(pObject->GetMaterialIndex(), pOther->GetMaterialIndex()) : NULL;
+		point.m_combinedFriction = pPair ? pPair->friction : pBody->getFriction() * pHit->getFriction();
+		point.m_combinedRestitution = 0;
+	}
+}
+
+// UNEXPOSED
+// Purpose: Enforce the limits in physics_performanceparams_t after a timestep. These are what keep prop spam
+// from stalling a server tick, objects that collide too much get frozen (if the game agrees).
+void CPhysicsEnvironment::EnforcePerformanceLimits() {
+	const int maxCollisions = m_perfparams.maxCollisionsPerObjectPerTimestep;
+	if (maxCollisions > 0) {
+		// MaterialPairContactAdded counted the new contact points of every object during collision detection,
+		// resting contacts don't count. Walked in object order so the same objects freeze no matter the thread count.
+		for (int i = 0; i < m_objects.Count(); i++) {
+			CPhysicsObject *pObject = static_cast<CPhysicsObject *>(m_objects[i]);
+			if (pObject->GetCollisionCount() == 0) continue;
+
+			if (pObject->GetCollisionCount() > maxCollisions && !(pObject->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE)) {
+				IPhysicsCollisionSolver *pSolver = m_pCollisionSolver->GetHandler();
+				if (!pSolver || pSolver->ShouldFreezeObject(pObject))
+					FreezeObject(pObject);
+			}
+
+			pObject->SetCollisionCount(0);
+		}
+	}
+
+	// Ran out of collision checks, the game can give us more for the rest of this tick
+	const int checks = m_iCollisionChecks;
+	m_stats.impactCollisionChecks += min(checks, m_iCollisionCheckLimit);
+	if (checks > m_iCollisionCheckLimit) {
+		IPhysicsCollisionSolver *pSolver = m_pCollisionSolver->GetHandler();
+		const int additional = pSolver ? pSolver->AdditionalCollisionChecksThisTick(m_iCollisionCheckLimit) : 0;
+		m_iCollisionCheckLimit += max(additional, 0);
+	}
+	m_iCollisionChecks = 0;
+}
+
+// UNEXPOSED
+// Purpose: Pick the object vs object pairs that get checked this timestep. Over budget, only pairs whose newer
+// object is older than a cutoff serial get through. Going by serial instead of by the order the narrowphase gets
+// to the pairs keeps it the same pairs no matter how many threads are dispatching.
+void CPhysicsEnvironment::BudgetCollisionChecks(btOverlappingPairCache *pPairCache) {
+	m_collisionCheckSerials.RemoveAll();
+	m_iCollisionCheckSerialLimit = UINT_MAX;
+
+	btBroadphasePairArray &pairs = pPairCache->getOverlappingPairArray();
+	for (int i = 0; i < pairs.size(); i++) {
+		const btCollisionObject *colObj0 = static_cast<btCollisionObject *>(pairs[i].m_pProxy0->m_clientObject);
+		const btCollisionObject *colObj1 = static_cast<btCollisionObject *>(pairs[i].m_pProxy1->m_clientObject);
+		if (!m_pBulletDispatcher->needsCollision(colObj0, colObj1)) continue;
+
+		const CPhysicsObject *pObj0 = static_cast<CPhysicsObject *>(colObj0->getUserPointer());
+		const CPhysicsObject *pObj1 = static_cast<CPhysicsObject *>(colObj1->getUserPointer());
+		if (!pObj0 || !pObj1 || pObj0->IsStatic() || pObj1->IsStatic()) continue;
+
+		m_collisionCheckSerials.AddToTail(max(pObj0->GetSerial(), pObj1->GetSerial()));
+	}
+
+	const int checks = m_collisionCheckSerials.Count();
+	m_iCollisionChecks = checks;
+	if (checks > m_iCollisionCheckLimit) {
+		// Serials that tie with the cutoff all lose out, so we never go over the limit
+		unsigned int *pSerials = m_collisionCheckSerials.Base();
+		std::nth_element(pSerials, pSerials + m_iCollisionCheckLimit, pSerials + checks);
+		m_iCollisionCheckSerialLimit = pSerials[m_iCollisionCheckLimit];
+	}
+}
+
+// UNEXPOSED
+bool CPhysicsEnvironment::CanCheckCollision(const CPhysicsObject *pObj0, const CPhysicsObject *pObj1) const {
+	if (pObj0->IsStatic() || pObj1->IsStatic())
+		return true;
+
+	return max(pObj0->GetSerial(), pObj1->GetSerial()) < m_iCollisionCheckSerialLimit;
+}
+
+// UNEXPOSED
+// Purpose: Take the object out of the simulation until the game wakes it. Just putting it to sleep doesn't hold,
+// whatever keeps hitting it wakes it (and its island) right back up next timestep.
+void CPhysicsEnvironment::FreezeObject(CPhysicsObject *pObject) {
+	btRigidBody *pBody = pObject->GetObject();
+	pBody->setLinearVelocity(btVector3(0, 0, 0));
+	pBody->setAngularVelocity(btVector3(0, 0, 0));
+
+	// Bullet's activate() and island sleeping leave DISABLE_SIMULATION alone, only CPhysicsObject::Wake undoes it
+	pBody->forceActivationState(DISABLE_SIMULATION);
+	pObject->SetFrozen(true);
+}
+
+// UNEXPOSED
+// Purpose: Sleep and wake islands as a unit. Bullet only sleeps an island once every object in it has been
+// under its own thresholds for a while, so one jittering prop keeps a whole settled pile awake. Instead we
+// compare the kinetic energy of the island against the energy it would have with every object at its sleep
+// thresholds, which lets heavy settled objects outvote a light jittering one.
+// When bullet wakes part of a sleeping island, the rest of the island is woken with it so the game hears
+// about the whole island on the same tick instead of object by object.
+void CPhysicsEnvironment::UpdateIslandSleep() {
+	const int numTags = m_pBulletDynamicsWorld->getSimulationIslandManager()->getUnionFind().getNumElements();
+	m_islands.SetCount(numTags);
+	for (int i = 0; i < numTags; i++) {
+		islandsleep_t &island = m_islands[i];
+		island.energy = 0;
+		island.threshold = 0;
+		island.quietTicks = INT_MAX;
+		island.numObjects = 0;
+		island.numAsleep = 0;
+		island.canSleep = true;
+		island.wasAsleep = false;
+	}
+
+	btCollisionObjectArray &colObjArray = m_pBulletDynamicsWorld->getCollisionObjectArray();
+	for (int i = 0; i < colObjArray.size(); i++) {
+		btRigidBody *pBody = btRigidBody::upcast(colObjArray[i]);
+		CPhysicsObject *pObject = static_cast<CPhysicsObject *>(colObjArray[i]->getUserPointer());
+		if (!pBody || !pObject) continue;
+
+		const int tag = pBody->getIslandTag();
+		if (tag < 0 || tag >= numTags) continue; // Static and kinematic objects aren't part of any island
+
+		islandsleep_t &island = m_islands[tag];
+		island.numObjects++;
+
+		const int state = pBody->getActivationState();
+		if (state == ISLAND_SLEEPING)
+			island.numAsleep++;
+		else if (state == DISABLE_DEACTIVATION || state == DISABLE_SIMULATION)
+			island.canSleep = false;
+
+		if (pObject->GetLastActivationState() == ISLAND_SLEEPING)
+			island.wasAsleep = true;
+
+		// Rotational energy is worked out in local space where the inertia tensor is diagonal
+		const btVector3 &invInertia = pBody->getInvInertiaDiagLocal();
+		const btVector3 inertia(invInertia.x() != 0 ? 1 / invInertia.x() : 0,
+								invInertia.y() != 0 ? 1 / invInertia.y() : 0,
+								invInertia.z() != 0 ? 1 / invInertia.z() : 0);
+		const btVector3 localAngVel = pBody->getAngularVelocity() * pBody->getWorldTransform().getBasis();
+		const btScalar mass = pBody->getInvMass() != 0 ? 1 / pBody->getInvMass() : 0;
+		const btScalar linThreshold = pBody->getLinearSleepingThreshold();
+		const btScalar angThreshold = pBody->getAngularSleepingThreshold();
+
+		island.energy += 0.5f * (mass * pBody->getLinearVelocity().length2() + localAngVel.dot(inertia * localAngVel));
+		island.threshold += 0.5f * (mass * linThreshold * linThreshold + angThreshold * angThreshold * (inertia.x() + inertia.y() + inertia.z()) / 3);
+		island.quietTicks = min(island.quietTicks, pObject->GetIslandQuietTicks());
+	}
+
+	const bool enabled = cvar_island_sleep.GetBool();
+	const int sleepTicks = cvar_island_sleep_ticks.GetInt();
+	m_islandStats.numIslands = 0;
+	m_islandStats.numSleepingIslands = 0;
+	for (int i = 0; i < numTags; i++) {
+		islandsleep_t &island = m_islands[i];
+		if (island.numObjects == 0) continue;
+
+		m_islandStats.numIslands++;
+		if (island.numAsleep == island.numObjects) {
+			m_islandStats.numSleepingIslands++;
+			continue;
+		}
+
+		if (enabled && island.canSleep && island.energy < island.threshold) {
+			island.quietTicks++;
+		} else {
+			island.quietTicks = 0;
+		}
+
+		if (island.quietTicks >= sleepTicks) {
+			m_islandStats.numSleepingIslands++;
+			m_islandStats.islandsSlept++;
+		} else if (island.wasAsleep) {
+			m_islandStats.islandsWoken++;
+		}
+	}
+
+	for (int i = 0; i < colObjArray.size(); i++) {
+		btRigidBody *pBody = btRigidBody::upcast(colObjArray[i]);
+		CPhysicsObject *pObject = static_cast<CPhysicsObject *>(colObjArray[i]->getUserPointer());
+		if (!pBody || !pObject) continue;
+
+		const int tag = pBody->getIslandTag();
+		if (tag < 0 || tag >= numTags) continue;
+
+		const islandsleep_t &island = m_islands[tag];
+		if (island.numAsleep == island.numObjects) continue;
+
+		if (island.quietTicks >= sleepTicks) {
+			pBody->setLinearVelocity(btVector3(0, 0, 0));
+			pBody->setAngularVelocity(btVector3(0, 0, 0));
+			pBody->setActivationState(ISLAND_SLEEPING);
+			pObject->SetIslandQuietTicks(0);
+			m_islandStats.objectsSlept++;
+		} else {
+			if (island.wasAsleep) {
+				if (pObject->GetLastActivationState() == ISLAND_SLEEPING)
+					m_islandStats.objectsWoken++;
+
+				if (pBody->getActivationState() != ACTIVE_TAG)
+					pBody->activate(true);
+			}
+
+			pObject->SetIslandQuietTicks(island.quietTicks);
+		}
+	}
+}
+
+class CControllerTickLoop : public btIParallelForBody {
+	public:
+		CControllerTickLoop(const CPhysicsEnvironment *pEnv, IController *const *pControllers, float dt) : m_pEnv(pEnv), m_pControllers(pControllers), m_dt(dt) {}
+
+		void forLoop(int iBegin, int iEnd) const override {
+			float deltaTime;
+			for (int i = iBegin; i < iEnd; i++) {
+				if (m_pEnv->GetControllerDeltaTime(m_pControllers[i], m_dt, &deltaTime))
+					m_pControllers[i]->Tick(deltaTime);
+			}
+		}
+
+	private:
+		const CPhysicsEnvironment *	m_pEnv;
+		IController *const *		m_pControllers;
+		float						m_dt;
+};
+
+// UNEXPOSED
+// Purpose: Work out if a controller runs this substep. Everything is derived from the substep counter and
+// the simulation clock, so raising bt_world_substeps doesn't change how often or with what deltaTime
+// step and fixed rate controllers run.
+bool CPhysicsEnvironment::GetControllerDeltaTime(const IController *pController, float subStepTime, float *pDeltaTime) const {
+	switch (pController->GetSchedule()) {
+		case CONTROLLER_SCHEDULE_STEP:
+			*pDeltaTime = subStepTime * m_subStepsPerStep;
+			return IsFirstSubStep();
+		case CONTROLLER_SCHEDULE_FIXED: {
+			const double interval = pController->GetTickInterval();
+			if (interval <= 0) break;
+
+			// Due when this substep crosses a multiple of the interval. m_simTime is the start of this substep.
+			*pDeltaTime = (float)interval;
+			const double epsilon = subStepTime * 0.001;
+			return floor((m_simTime + subStepTime + epsilon) / interval) > floor((m_simTime + epsilon) / interval);
+		}
+		default:
+			break;
+	}
+
+	*pDeltaTime = subStepTime;
+	return true;
+}
+
+// UNEXPOSED
+// Purpose: Sort the thread safe controllers into levels. A controller goes one level above the highest
+// level of any controller that shares an object with it, so conflicting controllers keep their
+// relative order and the result doesn't depend on thread timing.
+void CPhysicsEnvironment::BuildControllerSchedule() {
+	const int maxObjects = 4;
+	CPhysicsObject *pObjects[maxObjects];
+
+	for (int i = 0; i < m_controllers.Count(); i++) {
+		if (!m_controllers[i]->IsThreadSafe()) continue;
+
+		const int count = m_controllers[i]->GetControlledObjects(pObjects, maxObjects);
+		for (int j = 0; j < count; j++)
+			pObjects[j]->SetControllerLevel(-1);
+	}
+
+	CUtlVector<int> levels;
+	CUtlVector<int> levelCounts;
+	for (int i = 0; i < m_controllers.Count(); i++) {
+		if (!m_controllers[i]->IsThreadSafe()) {
+			levels.AddToTail(-1);
+			continue;
+		}
+
+		const int count = m_controllers[i]->GetControlledObjects(pObjects, maxObjects);
+		int level = 0;
+		for (int j = 0; j < count; j++)
+			level = max(level, pObjects[j]->GetControllerLevel() + 1);
+
+		for (int j = 0; j < count; j++)
+			pObjects[j]->SetControllerLevel(level);
+
+		levels.AddToTail(level);
+		while (levelCounts.Count() <= level)
+			levelCounts.AddToTail(0);
+
+		levelCounts[level]++;
+	}
+
+	// Counting sort by level (stable)
+	m_parallelLevelStart.SetCount(levelCounts.Count() + 1);
+	m_parallelLevelStart[0] = 0;
+	for (int i = 0; i < levelCounts.Count(); i++)
+		m_parallelLevelStart[i + 1] = m_parallelLevelStart[i] + levelCounts[i];
+
+	m_parallelControllers.SetCount(m_parallelLevelStart[levelCounts.Count()]);
+	for (int i = 0; i < levelCounts.Count(); i++)
+		levelCounts[i] = m_parallelLevelStart[i];
+
+	for (int i = 0; i < m_controllers.Count(); i++) {
+		if (levels[i] < 0) continue;
+		m_parallelControllers[levelCounts[levels[i]]++] = m_controllers[i];
+	}
+
+	m_bControllerScheduleDirty = false;
+}
+
+// UNEXPOSED
+void CPhysicsEnvironment::TickControllers(float dt) {
+	if (m_bControllerScheduleDirty)
+		BuildControllerSchedule();
+
+	// Parallel lane: one btParallelFor per level
+	for (int i = 0; i < m_parallelLevelStart.Count() - 1; i++) {
+		const int begin = m_parallelLevelStart[i];
+		const int end = m_parallelLevelStart[i + 1];
+		if (begin == end) continue;
+
+		CControllerTickLoop loop(this, m_parallelControllers.Base(), dt);
+		btParallelFor(begin, end, 16, loop);
+	}
+
+	// Serial lane: controllers that may call into game code, in list order.
+	// The game may destroy controllers from its callbacks, those leave holes until we're done.
+	m_bTickingControllers = true;
+
+	float deltaTime;
+	for (int i = 0; i < m_controllers.Count(); i++) {
+		IController *pController = m_controllers[i];
+		if (pController && !pController->IsThreadSafe() && GetControllerDeltaTime(pController, dt, &deltaTime))
+			pController->Tick(deltaTime);
+	}
+
+	m_bTickingControllers = false;
+
+	if (m_bControllerHoles) {
+		m_bControllerHoles = false;
+
+		// Back to front, so whatever gets swapped into a hole was already checked
+		for (int i = m_controllers.Count() - 1; i >= 0; i--) {
+			if (m_controllers[i]) continue;
+
+			m_controllers.FastRemove(i);
+			if (i < m_controllers.Count())
+				m_controllers[i]->SetControllerIndex(i);
+		}
+	}
+}
+
 // UNEXPOSED
 CPhysicsDragController *CPhysicsEnvironment::GetDragController() const
 {
@@ -1463,57 +3149,6 @@ btVector3 CPhysicsEnvironment::GetMaxAngularVelocity() const {
 	return btVector3(HL2BULL(m_perfparams.maxAngularVelocity), HL2BULL(m_perfparams.maxAngularVelocity), HL2BULL(m_perfparams.maxAngularVelocity));
 }
 
-// UNEXPOSED
-// Purpose: To be the biggest eyesore ever
-// Bullet doesn't provide many callbacks such as the ones we're looking for, so
-// we have to iterate through all the contact manifolds and generate the callbacks ourselves.
-// FIXME: Remove this function and implement callbacks in bullet code
-void CPhysicsEnvironment::DoCollisionEvents(float dt) {
-	if (m_pCollisionEvent) {
-		const int numManifolds = m_pBulletDynamicsWorld->getDispatcher()->getNumManifolds();
-		for (int i = 0; i < numManifolds; i++) {
-			btPersistentManifold *contactManifold = m_pBulletDynamicsWorld->getDispatcher()->getManifoldByIndexInternal(i);
-			if (contactManifold->getNumContacts() <= 0)
-				continue;
-
-			const btCollisionObject *obA = contactManifold->getBody0();
-			const btCollisionObject *obB = contactManifold->getBody1();
-			if (!obA || !obB) continue;
-
-			CPhysicsObject *physObA = static_cast<CPhysicsObject*>(obA->getUserPointer());
-			CPhysicsObject *physObB = static_cast<CPhysicsObject*>(obB->getUserPointer());
-
-			// These are our own internal objects, don't do callbacks on them.
-			if (obA->getInternalType() == btCollisionObject::CO_GHOST_OBJECT || obB->getInternalType() == btCollisionObject::CO_GHOST_OBJECT)
-				continue;
-
-			if (!(physObA->GetCallbackFlags() & CALLBACK_GLOBAL_FRICTION)  || !(physObB->GetCallbackFlags() & CALLBACK_GLOBAL_FRICTION))
-				continue;
-
-			for (int j = 0; j < contactManifold->getNumContacts(); j++) {
-				btManifoldPoint manPoint = contactManifold->getContactPoint(j);
-				
-				// FRICTION CALLBACK
-				// FIXME: We need to find the energy used by the friction! Bullet doesn't provide this in the manifold point.
-				// This may not be the proper variable but whatever, as of now it works.
-				const float energy = abs(manPoint.m_appliedImpulseLateral1);
-				if (energy > 0.05f) {
-					CPhysicsCollisionData data(&manPoint);
-					m_pCollisionEvent->Friction(static_cast<CPhysicsObject*>(obA->getUserPointer()),
-												ConvertEnergyToHL(energy),
-												static_cast<CPhysicsObject*>(obA->getUserPointer())->GetMaterialIndex(),
-												static_cast<CPhysicsObject*>(obB->getUserPointer())->GetMaterialIndex(),
-												&data);
-				}
-
-				// TODO: Collision callback
-				// Source wants precollision and postcollision callbacks (pre velocity and post velocity, etc.)
-				// How do we generate a callback before the collision happens?
-			}
-		}
-	}
-}
-
 // ==================
 // EVENTS
 // ==================
@@ -1546,7 +3181,7 @@ void CPhysicsEnvironment::HandleFluidEndTouch(CPhysicsFluidController *pControll
 // UNEXPOSED
 void CPhysicsEnvironment::HandleObjectEnteredTrigger(CPhysicsObject *pTrigger, CPhysicsObject *pObject) const
 {
-	if (pObject->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE) return;
+	if ((pTrigger->GetCallbackFlags() | pObject->GetCallbackFlags()) & CALLBACK_MARKED_FOR_DELETE) return;
 
 	if (m_pCollisionEvent)
 		m_pCollisionEvent->ObjectEnterTrigger(pTrigger, pObject);
@@ -1555,8 +3190,67 @@ void CPhysicsEnvironment::HandleObjectEnteredTrigger(CPhysicsObject *pTrigger, C
 // UNEXPOSED
 void CPhysicsEnvironment::HandleObjectExitedTrigger(CPhysicsObject *pTrigger, CPhysicsObject *pObject) const
 {
-	if (pObject->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE) return;
+	if ((pTrigger->GetCallbackFlags() | pObject->GetCallbackFlags()) & CALLBACK_MARKED_FOR_DELETE) return;
 
 	if (m_pCollisionEvent)
 		m_pCollisionEvent->ObjectLeaveTrigger(pTrigger, pObject);
 }
+
+// UNEXPOSED
+void CPhysicsEnvironment::MarkTriggerDirty(CPhysicsObject *pTrigger) {
+	if (pTrigger->IsTriggerDirty()) return;
+
+	pTrigger->SetTriggerDirty(true);
+	m_dirtyTriggers.AddToTail(pTrigger);
+}
+
+// UNEXPOSED
+void CPhysicsEnvironment::RemoveDirtyTrigger(CPhysicsObject *pTrigger) {
+	if (!pTrigger->IsTriggerDirty()) return;
+
+	pTrigger->SetTriggerDirty(false);
+	m_dirtyTriggers.FindAndFastRemove(pTrigger);
+}
+
+// UNEXPOSED
+// Purpose: Diff the overlaps of every trigger that had a broadphase pair added or removed since the last step and
+// hand the game the objects that entered and exited. Triggers nothing moved through cost nothing.
+void CPhysicsEnvironment::UpdateTriggers() {
+	if (m_dirtyTriggers.Count() == 0) return;
+
+	// Diff everything before calling into the game, it may create and remove triggers from the callbacks
+	m_triggerEvents.RemoveAll();
+	for (int i = 0; i < m_dirtyTriggers.Count(); i++) {
+		CPhysicsObject *pTrigger = m_dirtyTriggers[i];
+		pTrigger->SetTriggerDirty(false);
+
+		m_triggerEntered.RemoveAll();
+		m_triggerExited.RemoveAll();
+		pTrigger->UpdateTriggerOverlaps(m_triggerScratch, m_triggerEntered, m_triggerExited);
+
+		for (int j = 0; j < m_triggerExited.Count(); j++) {
+			triggerevent_t &event = m_triggerEvents[m_triggerEvents.AddToTail()];
+			event.pTrigger = pTrigger;
+			event.pObject = m_triggerExited[j];
+			event.entered = false;
+		}
+
+		for (int j = 0; j < m_triggerEntered.Count(); j++) {
+			triggerevent_t &event = m_triggerEvents[m_triggerEvents.AddToTail()];
+			event.pTrigger = pTrigger;
+			event.pObject = m_triggerEntered[j];
+			event.entered = true;
+		}
+	}
+
+	m_dirtyTriggers.RemoveAll();
+
+	// Anything the game deletes from here on is marked and queued, so the pointers stay good until the step is done
+	for (int i = 0; i < m_triggerEvents.Count(); i++) {
+		const triggerevent_t &event = m_triggerEvents[i];
+		if (event.entered)
+			HandleObjectEnteredTrigger(event.pTrigger, event.pObject);
+		else
+			HandleObjectExitedTrigger(event.pTrigger, event.pObject);
+	}
+}
@@ -7,10 +7,13 @@
 #include <vphysics/performance.h>
 #include <vphysics/stats.h>
 
+#include <atomic>
+
 class CPhysThreadManager;
 class btCollisionConfiguration;
 class btDispatcher;
 class btBroadphaseInterface;
+class btOverlappingPairCache;
 class btConstraintSolver;
 
 class IPhysicsConstraintGroup;
@@ -26,6 +29,10 @@ class CPhysicsEnvironment;
 class CPhysicsConstraint;
 class CPhysicsObject;
 class btConstraintSolverPoolMt;
+class CPhysicsTaskScheduler;
+class CPhysicsConstraintGroup;
+class CSolverBudget;
+class CPhysicsObjectPool;
 
 class CDebugDrawer;
 
@@ -33,6 +40,7 @@ class CCollisionSolver : public btOverlapFilterCallback {
 	public:
 		CCollisionSolver(CPhysicsEnvironment *pEnv) {m_pEnv = pEnv; m_pSolver = NULL;}
 		void SetHandler(IPhysicsCollisionSolver *pSolver) {m_pSolver = pSolver;}
+		IPhysicsCollisionSolver *GetHandler() const {return m_pSolver;}
 		virtual bool needBroadphaseCollision(btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1) const;
 
 		bool NeedsCollision(CPhysicsObject *pObj0, CPhysicsObject *pObj1) const;
@@ -157,17 +165,34 @@ public:
 
 	void									EnableConstraintNotify(bool bEnable);
 	void									DebugCheckContacts();
+
+	void									SetThreadBudget(int numThreads, bool highPriority);
+	int										GetThreadBudget() const;
+	void									SetSolverIterations(int iterations);
+	int										GetSolverIterations() const;
+	void									SetSolverResidualThreshold(float threshold);
+	float									GetSolverResidualThreshold() const;
+	void									SetSolverType(physics_solvertype_t type);
+	physics_solvertype_t					GetSolverType() const;
+	void									ReadSolverStats(physics_solverstats_t *pOutput) const;
+	void									ReadIslandStats(physics_islandstats_t *pOutput) const;
+	void									SetCollisionEventMinSpeed(float speed);
+	float									GetCollisionEventMinSpeed() const;
 public:
 	// Unexposed functions
 	btDiscreteDynamicsWorld*				GetBulletEnvironment() const;
 
-	float									GetInvPSIScale() const;
-	int										GetSimPSI() { return m_simPSI; }
 	float									GetSubStepTime() { return m_subStepTime; }
 	int										GetNumSubSteps() { return m_numSubSteps; }
+	int										GetNumSteps() const { return m_numSubSteps / m_subStepsPerStep; } // Steps the last Simulate call ran, 0 if it didn't step
 	int										GetCurSubStep() { return m_curSubStep; }
+	bool									IsFirstSubStep() const { return m_curSubStep % m_subStepsPerStep == 0; }
+
+	// Returns true if the controller is due this substep, and the deltaTime to tick it with
+	bool									GetControllerDeltaTime(const IController *pController, float subStepTime, float *pDeltaTime) const;
 
 	CPhysicsDragController *				GetDragController() const;
+	CPhysicsObjectPool *					GetObjectPool() const { return m_pObjectPool; }
 	CCollisionSolver *						GetCollisionSolver() const;
 
 	physics_performanceparams_t &			GetPerformanceSettings() { return m_perfparams; }
@@ -175,12 +200,39 @@ public:
 	btVector3								GetMaxLinearVelocity() const;
 	btVector3								GetMaxAngularVelocity() const;
 
+	void									InvalidateWorldSettings() { m_bWorldSettingsDirty = true; }
+	float									GetLastStepTime() const { return m_flLastStepTime; } // Seconds per step, averaged over the last frame that stepped
+	float									GetInterpolationTime() const { return m_flAccumulator; } // Time since the last step, [0..timestep)
+
+	// Bullet units, resolved from the ConVars at the start of every step. Read from the solver threads.
+	float									GetPairMinImpactSpeedBull(int materialIndex0, int materialIndex1) const;
+
+	// Resolved from bt_ccd_motionfraction at the start of every step, see CPhysicsObject::UpdateCCD
+	float									GetCCDMotionFraction() const { return m_flCCDMotionFraction; }
+
+	// Called by the dynamics world right before collision detection, adds to its predictive manifolds
+	void									CreateSpeculativeContacts(btAlignedObjectArray<btPersistentManifold *> &manifolds, btScalar dt);
+
+	// Whether MaterialPairContactAdded has to count new contacts for maxCollisionsPerObjectPerTimestep
+	bool									IsCountingCollisions() const { return m_perfparams.maxCollisionsPerObjectPerTimestep > 0; }
+
+	// Called by the dynamics world between the broadphase and the narrowphase, picks the object vs object pairs
+	// that fit in this timestep's maxCollisionChecksPerTimestep
+	void									BudgetCollisionChecks(btOverlappingPairCache *pPairCache);
+
+	// Called from the narrowphase. False for object vs object pairs that didn't make it into this timestep's budget.
+	bool									CanCheckCollision(const CPhysicsObject *pObj0, const CPhysicsObject *pObj1) const;
+
 	void									HandleConstraintBroken(CPhysicsConstraint *pConstraint) const; // Call this if you're a constraint that was just disabled/broken.
 	void									HandleFluidStartTouch(CPhysicsFluidController *pController, CPhysicsObject *pObject) const;
 	void									HandleFluidEndTouch(CPhysicsFluidController *pController, CPhysicsObject *pObject) const;
 	void									HandleObjectEnteredTrigger(CPhysicsObject *pTrigger, CPhysicsObject *pObject) const;
 	void									HandleObjectExitedTrigger(CPhysicsObject *pTrigger, CPhysicsObject *pObject) const;
 
+	// Triggers whose ghost overlaps changed get queued up and are diffed once per step, see UpdateTriggers
+	void									MarkTriggerDirty(CPhysicsObject *pTrigger);
+	void									RemoveDirtyTrigger(CPhysicsObject *pTrigger);
+
 private:
 	SolverType								m_solverType;
 	bool									m_multithreadedWorld;
@@ -189,18 +241,44 @@ private:
 	bool									m_bUseDeleteQueue;
 	bool									m_bConstraintNotify;
 	bool									m_deleteQuick;
+	bool									m_bControllerScheduleDirty;
+	bool									m_bTickingControllers;	// Removed controllers leave a NULL in m_controllers while set
+	bool									m_bControllerHoles;
 	float									m_timestep;
-	float									m_invPSIScale;
-	int										m_simPSICurrent;
-	int										m_simPSI;
-	int										m_numSubSteps;
+	double									m_simTime;
+	float									m_flAccumulator;
+	int										m_simPSICurrent;	// Substeps left in this Simulate call
+	int										m_numSubSteps;		// Substeps in this Simulate call
 	int										m_curSubStep;
+	int										m_subStepsPerStep;
 	float									m_subStepTime;
+	float									m_flLastStepTime;
+
+	// physics_performanceparams_t bookkeeping, reset every timestep
+	int										m_iCollisionChecks;
+	int										m_iCollisionCheckLimit;
+	unsigned int							m_iCollisionCheckSerialLimit;	// Object vs object pairs need both serials below this
+	CUtlVector<unsigned int>				m_collisionCheckSerials;
+
+	// Per environment overrides of the world ConVars, 0 / -1 means follow the ConVar
+	int										m_iThreadBudget;
+	int										m_iSolverIterations;
+	float									m_flResidualThreshold;
+	int										m_iSolverTypeOverride;
+	float									m_flCollisionMinSpeedOverride;
+	bool									m_bWorldSettingsDirty;
+
+	float									m_flCollisionMinSpeed;
+	float									m_flCollisionThresholdScale;
+	float									m_flCCDMotionFraction;
 
 	btCollisionConfiguration *				m_pBulletConfiguration;
 	btCollisionDispatcher *					m_pBulletDispatcher;
 	btBroadphaseInterface *					m_pBulletBroadphase;
 	btConstraintSolver *					m_pBulletSolver;
+	btConstraintSolver *					m_pBulletSolverMt; // Parallel solver for large islands, multithreaded worlds only
+	CSolverBudget *							m_pSolverBudget;
+	CPhysicsObjectPool *					m_pObjectPool;
 	btDiscreteDynamicsWorld *				m_pBulletDynamicsWorld;
 	btOverlappingPairCallback *				m_pBulletGhostCallback;
 
@@ -209,6 +287,11 @@ private:
 
 	CUtlVector<CPhysicsFluidController *>	m_fluids;
 	CUtlVector<IController *>				m_controllers;
+	CUtlVector<CPhysicsConstraintGroup *>	m_constraintGroups;
+
+	// Thread safe controllers grouped into levels, controllers in the same level write to disjoint objects
+	CUtlVector<IController *>				m_parallelControllers;
+	CUtlVector<int>							m_parallelLevelStart;
 
 	CCollisionEventListener *				m_pCollisionListener;
 	CCollisionSolver *						m_pCollisionSolver;
@@ -223,17 +306,58 @@ private:
 
 	physics_performanceparams_t				m_perfparams;
 	physics_stats_t							m_stats;
+	physics_islandstats_t					m_islandStats;
+
+	// Scratch for UpdateIslandSleep, indexed by bullet island tag
+	struct islandsleep_t {
+		btScalar	energy;			// Kinetic energy of the island
+		btScalar	threshold;		// Kinetic energy every body in the island would have at its sleep thresholds
+		int			quietTicks;
+		int			numObjects;
+		int			numAsleep;
+		bool		canSleep;
+		bool		wasAsleep;		// Some object was reported asleep to the game
+	};
+	CUtlVector<islandsleep_t>				m_islands;
+
+	struct triggerevent_t {
+		CPhysicsObject *	pTrigger;
+		CPhysicsObject *	pObject;
+		bool				entered;
+	};
+	CUtlVector<CPhysicsObject *>			m_dirtyTriggers;
+	CUtlVector<triggerevent_t>				m_triggerEvents;
+	CUtlVector<CPhysicsObject *>			m_triggerScratch;
+	CUtlVector<CPhysicsObject *>			m_triggerEntered;
+	CUtlVector<CPhysicsObject *>			m_triggerExited;
 
 	CDebugDrawer *							m_debugdraw;
 
 	CPhysThreadManager*						m_pThreadManager;
+	CPhysicsTaskScheduler *					m_pTaskScheduler;
 
 private:
 	static void								TickCallback(btDynamicsWorld *world, btScalar timestep);
 	void									BulletTick(btScalar timeStep);
-	void									DoCollisionEvents(float dt);
+	void									BuildControllerSchedule();
+	void									TickControllers(float dt);
 	void									Simulate(float deltaTime);
 	void									CreateEmptyDynamicsWorld();
+	btConstraintSolver *					CreateSolver(SolverType type);
+	btConstraintSolverPoolMt *				CreateSolverPool(int threadCount);
+	void									UpdateSolverBudget();
+	void									AddObject(CPhysicsObject *pObject);
+	void									RemoveObject(CPhysicsObject *pObject);
+	void									AddController(IController *pController);
+	void									RemoveController(IController *pController);
+	void									SweepCompoundObjects(btScalar dt);
+	void									EnforcePerformanceLimits();
+	void									UpdateIslandSleep();
+	void									UpdateTriggers();
+	void									FreezeObject(CPhysicsObject *pObject);
+	void									ApplyWorldSettings();
+	void									ApplyThreadBudget(int numThreads);
+	void									ApplySolverType(SolverType type);
 };
 
 #endif // PHYSICS_ENVIRONMENT_H
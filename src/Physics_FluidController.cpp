@@ -6,6 +6,7 @@
 #include "Physics_Environment.h"
 #include "Physics_SurfaceProps.h"
 #include "Physics_Collision.h"
+#include "Physics_Buoyancy.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -21,6 +22,9 @@ class CPhysicsFluidCallback : public btGhostObjectCallback {
 		}
 
 		void addedOverlappingObject(btCollisionObject *pObject) {
+			// Only rigid bodies float, not triggers and other fluids
+			if (pObject->getInternalType() != btCollisionObject::CO_RIGID_BODY) return;
+
 			CPhysicsObject *pPhys = (CPhysicsObject *)pObject->getUserPointer();
 			if (!pPhys) return;
 
@@ -28,6 +32,9 @@ class CPhysicsFluidCallback : public btGhostObjectCallback {
 		}
 
 		void removedOverlappingObject(btCollisionObject *pObject) {
+			// Only rigid bodies float, not triggers and other fluids
+			if (pObject->getInternalType() != btCollisionObject::CO_RIGID_BODY) return;
+
 			CPhysicsObject *pPhys = (CPhysicsObject *)pObject->getUserPointer();
 			if (!pPhys) return;
 
@@ -47,6 +54,7 @@ CPhysicsFluidController::CPhysicsFluidController(CPhysicsEnvironment *pEnv, CPhy
 	m_pGameData = NULL;
 	m_iContents = 0;
 	m_vSurfacePlane = Vector4D(0, 0, 0, 0);
+	m_currentVelocity.setZero();
 
 	if (pParams) {
 		m_pGameData = pParams->pGameData;
@@ -80,17 +88,19 @@ CPhysicsFluidController::~CPhysicsFluidController() {
 	m_pEnv->GetBulletEnvironment()->removeCollisionObject(m_pGhostObject);
 	delete m_pGhostObject;
 	delete m_pCallback;
+
+	// Removing the ghost should have emptied these through ObjectRemoved
+	for (int i = 0; i < m_awakeObjects.Count(); i++)
+		m_awakeObjects[i]->RemoveTouchingFluid(this);
+
+	for (int i = 0; i < m_sleepingObjects.Count(); i++)
+		m_sleepingObjects[i]->RemoveTouchingFluid(this);
 }
 
 void CPhysicsFluidController::WakeAllSleepingObjects() {
-	int count = m_pGhostObject->getNumOverlappingObjects();
-	for (int i = 0; i < count; i++) {
-		btRigidBody *body = btRigidBody::upcast(m_pGhostObject->getOverlappingObject(i));
-		if (!body)
-			continue;
-
-		body->activate(true);
-	}
+	// Activating doesn't move them back to m_awakeObjects yet, the object tracker does once the state change shows up
+	for (int i = 0; i < m_sleepingObjects.Count(); i++)
+		m_sleepingObjects[i]->GetObject()->activate(true);
 }
 
 void CPhysicsFluidController::SetGameData(void *pGameData) {
@@ -119,164 +129,118 @@ int	CPhysicsFluidController::GetContents() const {
 	return m_iContents;
 }
 
-static btVector3 calcConvexCenter(btConvexHullShape *pShape, btVector3 &planePos, btVector3 &planeNorm) {
-	// Basic average
-	btVector3 sum(0, 0, 0);
+static ConVar cvar_fluid_damping("bt_fluid_damping", "1", FCVAR_REPLICATED, "Linear and angular damping (per second) in fluids, scaled by how much of an object is submerged. Floating objects settle and sleep thanks to this", true, 0, false, 0);
 
-	if (pShape->getNumPoints() > 0) {
-		for (int i = 0; i < pShape->getNumPoints(); i++) {
-			btVector3 point = pShape->getScaledPoint(i);
-			point -= planePos;
+// Submerged volume (m^3) and its centroid in shape space, plane in shape space too. totalVolume is the volume of the whole shape.
+static btScalar ComputeSubmerged(CPhysicsObject *pObject, const btVector3 &normal, btScalar dist, btVector3 &center, btScalar &totalVolume) {
+	const btCollisionShape *pShape = pObject->GetObject()->getCollisionShape();
 
-			// Only add the point if it's submerged
-			if (point.dot(planeNorm) < 0)
-				sum += pShape->getScaledPoint(i);
-		}
-
-		sum /= static_cast<btScalar>(pShape->getNumPoints());
+	// Spheres make their own shape and don't have a CPhysCollide
+	if (pShape->getShapeType() == SPHERE_PROXYTYPE) {
+		const btScalar radius = ((const btSphereShape *)pShape)->getRadius();
+		totalVolume = btScalar(4.0 / 3.0) * SIMD_PI * radius * radius * radius;
+		return CBuoyancyShape::ComputeSphereSubmerged(btVector3(0, 0, 0), radius, normal, dist, center);
 	}
 
-	return sum;
-}
-
-// Find the object's center of buoyancy
-// This would be the center of all submerged points
-// You can bisect the object by the plane of the water surface to get all points
-// submerged, then calculate the center of all those points
-// planePos: World space plane position
-// planeNorm: World space plane normal
-static btVector3 calculateBuoyantCenter(btRigidBody *pBody, btVector3 &planePos, btVector3 &planeNorm) {
-	btVector3 center(0, 0, 0);
-
-	btVector3 relPlanePos = pBody->getWorldTransform().inverse() * planePos;
-	btVector3 relNorm = quatRotate(pBody->getWorldTransform().getRotation().inverse(), planeNorm);
-
-	btCollisionShape *pShape = pBody->getCollisionShape();
-	if (pShape->getShapeType() == COMPOUND_SHAPE_PROXYTYPE) {
-		btCompoundShape *pCompound = (btCompoundShape *)pShape;
-		for (int i = 0; i < pCompound->getNumChildShapes(); i++) {
-			btCollisionShape *pChild = pCompound->getChildShape(i);
-			if (pChild->getShapeType() == CONVEX_HULL_SHAPE_PROXYTYPE) {
-				center += calcConvexCenter((btConvexHullShape *)pChild, relPlanePos, relNorm);
-			}
-		}
+	CPhysCollide *pCollide = pObject->GetCollide();
+	const CBuoyancyShape *pBuoyancy = pCollide ? pCollide->GetBuoyancyShape() : NULL;
+	if (!pBuoyancy) return 0;
 
-		if (pCompound->getNumChildShapes() > 0)
-			center /= static_cast<btScalar>(pCompound->getNumChildShapes());
-	}
-
-	return center;
+	totalVolume = pBuoyancy->GetVolume();
+	return pBuoyancy->ComputeSubmerged(normal, dist, center);
 }
 
-// TODO: Refactor this code to be less messy.
+// Buoyancy is the weight of the fluid displaced by the submerged part of each hull, acting at its centroid.
+// Hulls are clipped against the surface plane exactly, so a floating object comes to rest instead of bobbing.
+// Only awake objects are visited, so water full of settled props costs nothing.
 void CPhysicsFluidController::Tick(float dt) {
-	// TODO: Buoyancy calculation
-	int numObjects = m_pGhostObject->getNumOverlappingObjects();
-	for (int i = 0; i < numObjects; i++) {
-		btRigidBody *body = btRigidBody::upcast(m_pGhostObject->getOverlappingObject(i));
-		Assert(body);
-		if (!body) continue;
-
-		CPhysicsObject *pObject = (CPhysicsObject *)body->getUserPointer();
-		Assert(pObject);
-
-		// Find the surface plane's world pos (center at the very top)
-		btVector3 surfPos = m_pGhostObject->getWorldTransform().getOrigin();
-		btVector3 surfNorm;
-		ConvertDirectionToBull(m_vSurfacePlane.AsVector3D(), surfNorm);
-
-		// btScalar fluidLen = ConvertDistanceToBull(m_vSurfacePlane.w);
+	if (m_awakeObjects.Count() == 0) return;
+
+	btVector3 surfNormal;
+	ConvertDirectionToBull(m_vSurfacePlane.AsVector3D(), surfNormal);
+	const btScalar surfDist = ConvertDistanceToBull(m_vSurfacePlane.w);
+	const btScalar damping = cvar_fluid_damping.GetFloat();
+
+	// Back to front, objects that fell asleep get swapped out
+	for (int i = m_awakeObjects.Count() - 1; i >= 0; i--) {
+		CPhysicsObject *pObject = m_awakeObjects[i];
+		btRigidBody *body = pObject->GetObject();
+
+		// Settled floaters are left asleep
+		if (!body->isActive()) {
+			m_awakeObjects.FastRemove(i);
+			m_sleepingObjects.AddToTail(pObject);
+			continue;
+		}
 
-		btVector3 omins, omaxs;
-		m_pGhostObject->getCollisionShape()->getAabb(m_pGhostObject->getWorldTransform(), omins, omaxs);
-		btScalar height = omaxs.y() - omins.y();
+		if (body->isStaticOrKinematicObject()) continue;
 
-		surfPos += surfNorm * (height / 2);
+		// Move the surface plane into the body's space
+		const btTransform &transform = body->getWorldTransform();
+		const btVector3 localNormal = transform.getBasis().transpose() * surfNormal;
+		const btScalar localDist = surfDist - surfNormal.dot(transform.getOrigin());
 
-		btVector3 center = calculateBuoyantCenter(body, surfPos, surfNorm);
-		center = body->getWorldTransform() * center; // Convert back into world space
+		btVector3 localCenter;
+		btScalar totalVolume = 0;
+		const btScalar submergedVolume = ComputeSubmerged(pObject, localNormal, localDist, localCenter, totalVolume);
+		if (submergedVolume <= 0 || totalVolume <= 0) continue;
 
-		btVector3 offset = center - surfPos;
-		btScalar submerged = surfNorm.dot(offset);
+		const btScalar fraction = btMin(submergedVolume / totalVolume, btScalar(1));
+		const btVector3 center = transform * localCenter;
 
 #ifdef _DEBUG
 		IVPhysicsDebugOverlay *pOverlay = m_pEnv->GetDebugOverlay();
 		if (pOverlay) {
 			Vector pos;
-			ConvertPosToHL(surfPos, pos);
-			pOverlay->AddBoxOverlay(pos, Vector(-8), Vector(8), QAngle(0, 0, 0), 255, 0, 0, 255, 0.f);
-			pOverlay->AddLineOverlay(pos, pos + m_vSurfacePlane.AsVector3D() * 32, 255, 0, 0, false, 0.f);
-
 			ConvertPosToHL(center, pos);
 			pOverlay->AddBoxOverlay(pos, Vector(-8), Vector(8), QAngle(0, 0, 0), 0, 0, 255, 255, 0.f);
-
-			if (submerged < 0) {
-				pOverlay->AddTextOverlay(pos, 0.f, "submerged %+04.2f", submerged);
-			}
+			pOverlay->AddTextOverlay(pos, 0.f, "submerged %.2f", fraction);
 		}
 #endif
 
-		if (submerged < 0) {
-			btVector3 mins, maxs;
-			body->getAabb(mins, maxs);
-
-			// Calc the volume coefficient
-			btScalar dist = -submerged;
-			float p = clamp(dist / 1.2f, 0.f, 1.f);
-			btScalar vol = p * pObject->GetVolume();
+		// The game's volume wins over the hulls' if it has one, it's what the mass and buoyancy ratio were tuned with
+		const btScalar volume = (pObject->GetVolume() > 0 ? pObject->GetVolume() : totalVolume) * fraction;
 
-			// TODO: Need a way to calculate this properly
-			// Force should be exactly equal to -gravity when submerged distance is 0
-			// density units kg/m^3
-			btVector3 force = (m_fDensity * -body->getGravity() * vol) * pObject->GetBuoyancyRatio();
+		// density units kg/m^3
+		btVector3 force = (m_fDensity * -body->getGravity() * volume) * pObject->GetBuoyancyRatio();
+		body->applyForce(force, center - transform.getOrigin());
 
-			btVector3 relPos = center - body->getWorldTransform().getOrigin();
-			body->applyForce(force, relPos);
-		}
-
-		// Old code that actually works better
-		/*
-		btVector3 mins, maxs, omins, omaxs;
-		body->getAabb(mins, maxs);
-		m_pGhostObject->getCollisionShape()->getAabb(m_pGhostObject->getWorldTransform(), omins, omaxs);
-
-		float height = maxs.y() - mins.y(); // If the plane for the surface can be non-upwards I'm going to murder something
-		//float height = abs(ConvertDistanceToBull(m_vSurfacePlane.w));
-		float dist = omaxs.y() - mins.y(); // Distance between top of water and bottom of object (how much of object is in water)
-		float p = clamp(dist / height, 0.0f, 1.0f);
-		float vol = (pObject->GetVolume() * p); // / 64; // Submerged volume
-
-		// TODO: We need to calculate this force at several points on the object (How do we determine what points?).
-		// Maybe have the points determined by the extents of the shape at 4 directions parallel to our surface
-		// Simulate buoyant force per convex or just on the compound?
-
-		// Simulate buoyant force per point submerged
-		// Divide it over all of the points that are submerged
-
-		// IVP calculates this force per triangle
-		btVector3 force = (m_fDensity * -body->getGravity() * vol) * pObject->GetBuoyancyRatio();
-		body->applyCentralForce(force);
-
-		// Damping
-		// FIXME: Damping would be way too much for an object only partially touching our surface (ex. giant fucking bridge with like 1 pixel in the water)
-		body->setLinearVelocity(body->getLinearVelocity() * (1.0f - (0.75f * dt)));
-		body->setAngularVelocity(body->getAngularVelocity() * (1.0f - (0.75f * dt)));
-		*/
+		// Fluid drag, relative to the current
+		const btScalar scale = btScalar(1) / (btScalar(1) + damping * fraction * dt);
+		body->setLinearVelocity(m_currentVelocity + (body->getLinearVelocity() - m_currentVelocity) * scale);
+		body->setAngularVelocity(body->getAngularVelocity() * scale);
 	}
 }
 
 // UNEXPOSED
 void CPhysicsFluidController::ObjectAdded(CPhysicsObject *pObject) {
+	pObject->AddTouchingFluid(this);
+	if (pObject->IsAsleep())
+		m_sleepingObjects.AddToTail(pObject);
+	else
+		m_awakeObjects.AddToTail(pObject);
+
 	m_pEnv->HandleFluidStartTouch(this, pObject);
 }
 
 // UNEXPOSED
 void CPhysicsFluidController::ObjectRemoved(CPhysicsObject *pObject) {
+	pObject->RemoveTouchingFluid(this);
+	if (!m_awakeObjects.FindAndFastRemove(pObject))
+		m_sleepingObjects.FindAndFastRemove(pObject);
+
 	// Don't send the callback on objects that are being removed
 	if (!pObject->IsBeingRemoved())
 		m_pEnv->HandleFluidEndTouch(this, pObject);
 }
 
+// UNEXPOSED
+// Called by the object tracker when an object in our volume wakes up
+void CPhysicsFluidController::ObjectWoke(CPhysicsObject *pObject) {
+	if (m_sleepingObjects.FindAndFastRemove(pObject))
+		m_awakeObjects.AddToTail(pObject);
+}
+
 void CPhysicsFluidController::TransferToEnvironment(CPhysicsEnvironment *pDest) {
 
 }
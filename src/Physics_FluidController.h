@@ -29,6 +29,7 @@ class CPhysicsFluidController : public IPhysicsFluidController, public IControll
 		void					Tick(float deltaTime);
 		void					ObjectRemoved(CPhysicsObject *pObject);
 		void					ObjectAdded(CPhysicsObject *pObject);
+		void					ObjectWoke(CPhysicsObject *pObject);
 
 		void					TransferToEnvironment(CPhysicsEnvironment *pDest);
 	private:
@@ -42,6 +43,11 @@ class CPhysicsFluidController : public IPhysicsFluidController, public IControll
 		CPhysicsEnvironment *	m_pEnv;
 		btGhostObject *			m_pGhostObject;
 		CPhysicsFluidCallback *	m_pCallback;
+
+		// Objects in our volume. Tick only goes through the awake ones and moves those that fell asleep over,
+		// the object tracker hands them back through ObjectWoke.
+		CUtlVector<CPhysicsObject *> m_awakeObjects;
+		CUtlVector<CPhysicsObject *> m_sleepingObjects;
 };
 
 CPhysicsFluidController *CreateFluidController(CPhysicsEnvironment *pEnv, CPhysicsObject *pFluidObject, fluidparams_t *pParams);
@@ -3,32 +3,46 @@
 #include "Physics_FrictionSnapshot.h"
 #include "Physics_Object.h"
 #include "Physics_Environment.h"
+#include "Physics_SurfaceProps.h"
 
 #include "convert.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+// m_deleteMasks has a bit per contact point
+COMPILE_TIME_ASSERT(MANIFOLD_CACHE_SIZE <= 8);
+
 CPhysicsFrictionSnapshot::CPhysicsFrictionSnapshot(CPhysicsObject *pObject) {
 	m_pObject = pObject;
 	m_iCurContactPoint = 0;
 	m_iCurManifold = 0;
+	m_bHasMarkedContacts = false;
 
 	CPhysicsEnvironment *pEnv = pObject->GetVPhysicsEnvironment();
 	btRigidBody *pBody = pObject->GetObject();
-	int numManifolds = pEnv->GetBulletEnvironment()->getDispatcher()->getNumManifolds();
+	btDispatcher *pDispatcher = pEnv->GetBulletEnvironment()->getDispatcher();
+	int numManifolds = pDispatcher->getNumManifolds();
 	for (int i = 0; i < numManifolds; i++) {
-		btPersistentManifold *pManifold = pEnv->GetBulletEnvironment()->getDispatcher()->getManifoldByIndexInternal(i);
+		btPersistentManifold *pManifold = pDispatcher->getManifoldByIndexInternal(i);
 		const btCollisionObject *pObjA = pManifold->getBody0();
 		const btCollisionObject *pObjB = pManifold->getBody1();
 
 		if (pManifold->getNumContacts() <= 0)
 			continue;
 
-		if (pObjA == pBody || pObjB == pBody) {
-			m_manifolds.AddToTail(pManifold);
-		}
+		if (pObjA != pBody && pObjB != pBody)
+			continue;
+
+		// Internal objects the game doesn't know about
+		if (!pObjA->getUserPointer() || !pObjB->getUserPointer())
+			continue;
+
+		m_manifolds.AddToTail(pManifold);
 	}
+
+	m_deleteMasks.SetCount(m_manifolds.Count());
+	m_deleteMasks.FillWithValue(0);
 }
 
 CPhysicsFrictionSnapshot::~CPhysicsFrictionSnapshot() {
@@ -66,51 +80,101 @@ int CPhysicsFrictionSnapshot::GetMaterial(int index) {
 }
 
 void CPhysicsFrictionSnapshot::GetContactPoint(Vector &out) {
-	btManifoldPoint bullManifoldPoint = m_manifolds[m_iCurManifold]->getContactPoint(m_iCurContactPoint);
-
-	btVector3 bullPos = bullManifoldPoint.getPositionWorldOnA();
-	if (m_pObject->GetObject() == m_manifolds[m_iCurManifold]->getBody1()) {
-		bullPos = bullManifoldPoint.getPositionWorldOnB(); // Our object is object B, so get the pos for B
-	}
+	const btManifoldPoint &point = GetCurrentPoint();
 
-	ConvertPosToHL(bullPos, out);
+	// The point on our own object
+	ConvertPosToHL(IsObjectA() ? point.getPositionWorldOnA() : point.getPositionWorldOnB(), out);
 }
 
 void CPhysicsFrictionSnapshot::GetSurfaceNormal(Vector &out) {
-	btManifoldPoint bullManifoldPoint = m_manifolds[m_iCurManifold]->getContactPoint(m_iCurContactPoint);
-	btVector3 norm = bullManifoldPoint.m_normalWorldOnB;
+	btVector3 norm = GetCurrentPoint().m_normalWorldOnB;
 
 	// Flip the normal so it's world on A (needs to be pointed away from m_pObject)
-	if (m_pObject->GetObject() == m_manifolds[m_iCurManifold]->getBody0())
+	if (IsObjectA())
 		norm *= -1;
 
 	ConvertDirectionToHL(norm, out); // The game expects the normal to point away from our object
 }
 
 float CPhysicsFrictionSnapshot::GetNormalForce() {
-	btManifoldPoint bullManifoldPoint = m_manifolds[m_iCurManifold]->getContactPoint(m_iCurContactPoint);
-	return BULL2HL(bullManifoldPoint.m_appliedImpulse); // Force impulse to HL (kg * m/s) -> (kg * in/s)
+	return BULL2HL(GetCurrentPoint().m_appliedImpulse); // Force impulse to HL (kg * m/s) -> (kg * in/s)
 }
 
 float CPhysicsFrictionSnapshot::GetEnergyAbsorbed() {
-	NOT_IMPLEMENTED
-	return 0;
+	return ConvertEnergyToHL(ComputeFrictionEnergy(m_manifolds[m_iCurManifold], GetCurrentPoint()));
 }
 
+// Redo the friction coefficient from the surface properties (the game may have changed materials) and clamp the
+// friction impulse back into the friction cone of the current normal impulse. The solver warm starts from it.
 void CPhysicsFrictionSnapshot::RecomputeFriction() {
-	NOT_IMPLEMENTED
+	btManifoldPoint &point = GetCurrentPoint();
+	const btPersistentManifold *pManifold = m_manifolds[m_iCurManifold];
+	const CPhysicsObject *pObjA = (CPhysicsObject *)pManifold->getBody0()->getUserPointer();
+	const CPhysicsObject *pObjB = (CPhysicsObject *)pManifold->getBody1()->getUserPointer();
+
+	const materialpair_t *pPair = g_SurfaceDatabase.GetMaterialPair(pObjA->GetMaterialIndex(), pObjB->GetMaterialIndex());
+	if (pPair)
+		point.m_combinedFriction = pPair->friction;
+
+	const btScalar maxImpulse = point.m_combinedFriction * btFabs(point.m_appliedImpulse);
+	const btScalar impulseSqr = point.m_appliedImpulseLateral1 * point.m_appliedImpulseLateral1 + point.m_appliedImpulseLateral2 * point.m_appliedImpulseLateral2;
+	if (impulseSqr > maxImpulse * maxImpulse) {
+		const btScalar scale = maxImpulse / btSqrt(impulseSqr);
+		point.m_appliedImpulseLateral1 *= scale;
+		point.m_appliedImpulseLateral2 *= scale;
+	}
 }
 
+// Next step starts solving friction at this contact from zero instead of warm starting
 void CPhysicsFrictionSnapshot::ClearFrictionForce() {
-	NOT_IMPLEMENTED
+	btManifoldPoint &point = GetCurrentPoint();
+	point.m_appliedImpulseLateral1 = 0;
+	point.m_appliedImpulseLateral2 = 0;
 }
 
 void CPhysicsFrictionSnapshot::MarkContactForDelete() {
-	NOT_IMPLEMENTED
+	m_deleteMasks[m_iCurManifold] |= 1 << m_iCurContactPoint;
+	m_bHasMarkedContacts = true;
 }
 
+// Removes every marked contact in one go. The narrowphase re-adds contacts that are still touching next step.
+// Afterwards the snapshot starts over at the first contact that's left.
 void CPhysicsFrictionSnapshot::DeleteAllMarkedContacts(bool wakeObjects) {
-	NOT_IMPLEMENTED
+	if (!m_bHasMarkedContacts) return;
+
+	for (int i = m_manifolds.Count() - 1; i >= 0; i--) {
+		const unsigned char mask = m_deleteMasks[i];
+		if (!mask) continue;
+
+		btPersistentManifold *pManifold = m_manifolds[i];
+		const int numContacts = pManifold->getNumContacts();
+		if (mask == (1 << numContacts) - 1) {
+			pManifold->clearManifold();
+		} else {
+			// Back to front, removeContactPoint moves the last point into the removed slot
+			for (int j = numContacts - 1; j >= 0; j--) {
+				if (mask & (1 << j))
+					pManifold->removeContactPoint(j);
+			}
+		}
+
+		if (wakeObjects) {
+			// Statics ignore activate
+			const_cast<btCollisionObject *>(pManifold->getBody0())->activate();
+			const_cast<btCollisionObject *>(pManifold->getBody1())->activate();
+		}
+
+		if (pManifold->getNumContacts() == 0) {
+			m_manifolds.Remove(i);
+			m_deleteMasks.Remove(i);
+		} else {
+			m_deleteMasks[i] = 0;
+		}
+	}
+
+	m_bHasMarkedContacts = false;
+	m_iCurManifold = 0;
+	m_iCurContactPoint = 0;
 }
 
 void CPhysicsFrictionSnapshot::NextFrictionData() {
@@ -122,8 +186,15 @@ void CPhysicsFrictionSnapshot::NextFrictionData() {
 }
 
 float CPhysicsFrictionSnapshot::GetFrictionCoefficient() {
-	btManifoldPoint bullManifoldPoint = m_manifolds[m_iCurManifold]->getContactPoint(m_iCurContactPoint);
-	return bullManifoldPoint.m_combinedFriction;
+	return GetCurrentPoint().m_combinedFriction;
+}
+
+btManifoldPoint &CPhysicsFrictionSnapshot::GetCurrentPoint() {
+	return m_manifolds[m_iCurManifold]->getContactPoint(m_iCurContactPoint);
+}
+
+bool CPhysicsFrictionSnapshot::IsObjectA() const {
+	return m_manifolds[m_iCurManifold]->getBody0() == m_pObject->GetObject();
 }
 
 /***********************
@@ -134,4 +205,28 @@ CPhysicsFrictionSnapshot *CreateFrictionSnapshot(CPhysicsObject *pObject) {
 	if (!pObject) return NULL;
 
 	return new CPhysicsFrictionSnapshot(pObject);
-}
\ No newline at end of file
+}
+
+// The friction impulse dotted with the sliding velocity. Static friction holds the surfaces together,
+// so resting contacts come out at (close to) zero.
+btScalar ComputeFrictionEnergy(const btPersistentManifold *pManifold, const btManifoldPoint &point, btVector3 *pSlideVelocity) {
+	if (pSlideVelocity)
+		pSlideVelocity->setZero();
+
+	const btVector3 frictionImpulse = point.m_appliedImpulseLateral1 * point.m_lateralFrictionDir1 + point.m_appliedImpulseLateral2 * point.m_lateralFrictionDir2;
+	if (frictionImpulse.fuzzyZero())
+		return 0;
+
+	const btRigidBody *pBodyA = btRigidBody::upcast(pManifold->getBody0());
+	const btRigidBody *pBodyB = btRigidBody::upcast(pManifold->getBody1());
+	const btVector3 velA = pBodyA ? pBodyA->getVelocityInLocalPoint(point.getPositionWorldOnA() - pBodyA->getCenterOfMassPosition()) : btVector3(0, 0, 0);
+	const btVector3 velB = pBodyB ? pBodyB->getVelocityInLocalPoint(point.getPositionWorldOnB() - pBodyB->getCenterOfMassPosition()) : btVector3(0, 0, 0);
+
+	btVector3 relVel = velB - velA;
+	relVel -= point.m_normalWorldOnB * relVel.dot(point.m_normalWorldOnB);
+
+	if (pSlideVelocity)
+		*pSlideVelocity = relVel;
+
+	return btFabs(frictionImpulse.dot(relVel));
+}
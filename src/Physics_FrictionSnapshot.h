@@ -35,12 +35,23 @@ class CPhysicsFrictionSnapshot : public IPhysicsFrictionSnapshot
 		void								NextFrictionData();
 		float								GetFrictionCoefficient();
 	private:
+		btManifoldPoint &					GetCurrentPoint();
+		bool								IsObjectA() const;
+
+		// Points into the live manifolds, so everything we change is seen by the next step.
+		// Manifolds are only valid until the next simulation step, as is the snapshot.
 		CUtlVector<btPersistentManifold *>	m_manifolds;
+		CUtlVector<unsigned char>			m_deleteMasks; // Bit per contact point marked for delete, parallel to m_manifolds
 		CPhysicsObject *					m_pObject;
 		int									m_iCurManifold;
 		int									m_iCurContactPoint;
+		bool								m_bHasMarkedContacts;
 };
 
 CPhysicsFrictionSnapshot *CreateFrictionSnapshot(CPhysicsObject *pObject);
 
+// Work friction did at a contact over the last step in bullet units, also used for the friction events.
+// pSlideVelocity gets the sliding velocity of B relative to A at the contact, if given.
+btScalar ComputeFrictionEnergy(const btPersistentManifold *pManifold, const btManifoldPoint &point, btVector3 *pSlideVelocity = NULL);
+
 #endif // PHYSICS_FRICTIONSNAPSHOT_H
@@ -20,6 +20,7 @@ IPhysicsMotionController *CreateMotionController(CPhysicsEnvironment *pEnv, IMot
 
 CPhysicsMotionController::CPhysicsMotionController(IMotionEvent *pHandler, CPhysicsEnvironment *pEnv) {
 	m_handler = pHandler;
+	m_batchHandler = NULL;
 	m_pEnv = pEnv;
 }
 
@@ -30,65 +31,120 @@ CPhysicsMotionController::~CPhysicsMotionController() {
 }
 
 void CPhysicsMotionController::Tick(float deltaTime) {
-	if (!m_handler) return;
+	if (!m_handler && !m_batchHandler) return;
 
-	for (int i = 0; i < m_objectList.Count(); i++) {
-		Vector speed;
-		AngularImpulse rot;
-		
-		CPhysicsObject *pObject = m_objectList[i];
-		IMotionEvent::simresult_e ret = m_handler->Simulate(this, pObject, deltaTime, speed, rot);
+	int count = m_objectList.Count();
+	if (count == 0) return;
 
-		speed *= deltaTime;
-		rot *= deltaTime;
+	// Snapshot the list, handlers are allowed to destroy objects while we're simulating.
+	m_tickObjects.CopyArray(m_objectList.Base(), count);
+	m_results.SetCount(count);
 
-		Vector curVel, curAngVel;
-		pObject->GetVelocity(&curVel, &curAngVel);
+	if (m_batchHandler) {
+		m_states.SetCount(count);
+		for (int i = 0; i < count; i++) {
+			CPhysicsObject *pObject = m_tickObjects[i];
+			motionstate_t &state = m_states[i];
 
-		switch (ret) {
-			case IMotionEvent::SIM_NOTHING: {
-				break;
-			}
-			case IMotionEvent::SIM_LOCAL_ACCELERATION: {
-				// Convert velocity to world space
-				Vector newVel;
-				pObject->LocalToWorldVector(&newVel, speed);
+			state.pObject = pObject;
+			pObject->GetPosition(&state.position, &state.angles);
+			pObject->GetVelocity(&state.velocity, &state.angularVelocity);
+		}
 
-				pObject->AddVelocity(&newVel, &rot); // Rotation already in local space.
-				break;
-			}
-			case IMotionEvent::SIM_LOCAL_FORCE: {
-				Vector newVel;
-				pObject->LocalToWorldVector(&newVel, speed);
+		m_batchHandler->SimulateBatch(this, m_states.Base(), m_results.Base(), count, deltaTime);
+	} else {
+		for (int i = 0; i < count; i++) {
+			CPhysicsObject *pObject = m_tickObjects[i];
+			if (!pObject) continue;
 
-				pObject->ApplyForceCenter(newVel);
-				pObject->ApplyTorqueCenter(rot);
-				break;
-			}
+			motionresult_t &result = m_results[i];
+			result.mode = m_handler->Simulate(this, pObject, deltaTime, result.linear, result.angular);
+		}
+	}
+
+	ApplyResults(deltaTime);
+	m_tickObjects.RemoveAll();
+}
+
+// Applies everything the handler returned this tick in one pass, straight on the rigid bodies.
+// Same semantics as calling AddVelocity/ApplyForceCenter/ApplyTorqueCenter on each object.
+void CPhysicsMotionController::ApplyResults(float deltaTime) {
+	btVector3 maxLinVel = m_pEnv->GetMaxLinearVelocity();
+
+	for (int i = 0; i < m_tickObjects.Count(); i++) {
+		CPhysicsObject *pObject = m_tickObjects[i];
+		if (!pObject) continue;
+
+		const motionresult_t &result = m_results[i];
+		if (result.mode == IMotionEvent::SIM_NOTHING) continue;
+
+		if (!pObject->IsMoveable() || !pObject->IsMotionEnabled()) continue;
+
+		btRigidBody *pBody = pObject->GetObject();
+		const btMatrix3x3 &basis = pBody->getWorldTransform().getBasis();
+
+		btVector3 linear, angular;
+		switch (result.mode) {
+			case IMotionEvent::SIM_LOCAL_ACCELERATION:
 			case IMotionEvent::SIM_GLOBAL_ACCELERATION: {
-				pObject->AddVelocity(&speed, &rot);
+				ConvertPosToBull(result.linear * deltaTime, linear);
+				ConvertAngularImpulseToBull(result.angular * deltaTime, angular);
+
+				// Rotation is always in local space.
+				if (result.mode == IMotionEvent::SIM_LOCAL_ACCELERATION)
+					linear = basis * linear;
+
+				pBody->setLinearVelocity(pBody->getLinearVelocity() + linear);
+				pBody->setAngularVelocity(pBody->getAngularVelocity() + basis * angular);
 				break;
 			}
+			case IMotionEvent::SIM_LOCAL_FORCE:
 			case IMotionEvent::SIM_GLOBAL_FORCE: {
-				pObject->ApplyForceCenter(speed);
-				pObject->ApplyTorqueCenter(rot);
+				ConvertForceImpulseToBull(result.linear * deltaTime, linear);
+				ConvertAngularImpulseToBull(result.angular * deltaTime, angular);
+
+				if (result.mode == IMotionEvent::SIM_LOCAL_FORCE)
+					linear = basis * linear;
+
+				// Clamp the velocity change like ApplyForceCenter does.
+				btVector3 deltaLin = linear * pBody->getLinearFactor() * pBody->getInvMass();
+				for (int j = 0; j < 3; j++) {
+					if (fabs(deltaLin[j]) > maxLinVel[j])
+						deltaLin[j] = deltaLin[j] > 0 ? maxLinVel[j] : -maxLinVel[j];
+				}
+
+				pBody->setLinearVelocity(pBody->getLinearVelocity() + deltaLin);
+				pBody->applyTorqueImpulse(angular);
 				break;
 			}
 			default: {
-				DevWarning("VPhysics: Invalid motion controller event type returned (%d)\n", ret);
+				DevWarning("VPhysics: Invalid motion controller event type returned (%d)\n", result.mode);
+				continue;
 			}
 		}
+
+		pObject->Wake();
 	}
 }
 
 void CPhysicsMotionController::ObjectDestroyed(CPhysicsObject *pObject) {
 	m_objectList.FindAndRemove(pObject);
+
+	// Destroyed from inside a handler, don't touch it when applying results.
+	for (int i = 0; i < m_tickObjects.Count(); i++) {
+		if (m_tickObjects[i] == pObject)
+			m_tickObjects[i] = NULL;
+	}
 }
 
 void CPhysicsMotionController::SetEventHandler(IMotionEvent *handler) {
 	m_handler = handler;
 }
 
+void CPhysicsMotionController::SetBatchEventHandler(IMotionEventBatch *pHandler) {
+	m_batchHandler = pHandler;
+}
+
 void CPhysicsMotionController::AttachObject(IPhysicsObject *pObject, bool checkIfAlreadyAttached) {
 	Assert(pObject);
 	if (!pObject || pObject->IsStatic()) return;
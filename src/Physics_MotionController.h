@@ -10,13 +10,14 @@
 
 class CPhysicsEnvironment;
 
-class CPhysicsMotionController : public IController, public IPhysicsMotionController, public IObjectEventListener
+class CPhysicsMotionController : public IController, public IPhysicsMotionController32, public IObjectEventListener
 {
 	public:
 										CPhysicsMotionController(IMotionEvent *pHandler, CPhysicsEnvironment *pEnv);
 										~CPhysicsMotionController();
 
 		void							SetEventHandler(IMotionEvent *handler);
+		void							SetBatchEventHandler(IMotionEventBatch *pHandler);
 		void							AttachObject(IPhysicsObject *pObject, bool checkIfAlreadyAttached);
 		void							DetachObject(IPhysicsObject *pObject);
 
@@ -31,10 +32,18 @@ class CPhysicsMotionController : public IController, public IPhysicsMotionContro
 		void							ObjectDestroyed(CPhysicsObject *pObject);
 
 	private:
+		void							ApplyResults(float deltaTime);
+
 		IMotionEvent *					m_handler;
+		IMotionEventBatch *				m_batchHandler;
 		CUtlVector<CPhysicsObject *>	m_objectList;
 		CPhysicsEnvironment *			m_pEnv;
 
+		// Per tick scratch, objects destroyed mid-tick are set to NULL in m_tickObjects
+		CUtlVector<CPhysicsObject *>	m_tickObjects;
+		CUtlVector<motionstate_t>		m_states;
+		CUtlVector<motionresult_t>		m_results;
+
 		int								m_priority;
 };
 
@@ -4,6 +4,7 @@
 
 #include "miscmath.h"
 #include "Physics_Object.h"
+#include "Physics_ObjectPool.h"
 #include "Physics_Environment.h"
 #include "Physics_Collision.h"
 #include "Physics_Constraint.h"
@@ -17,6 +18,12 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+// Interned object names. Never shrinks, but there are only so many distinct names a game uses.
+static CUtlSymbolTableMT g_ObjectNames(0, 64, false);
+
+// Objects are only created on the main thread
+static unsigned int g_iNextObjectSerial = 0;
+
 /*****************************
 * CLASS CGhostTriggerCallback
 * Purpose: For BecomeTrigger, etc.
@@ -69,15 +76,31 @@ CPhysicsObject::CPhysicsObject() {
 	m_pObject = NULL;
 	m_pGhostObject = NULL;
 	m_pGhostCallback = NULL;
+	m_bTriggerDirty = false;
 	m_pName = "UNINITIALIZED";
 
 	m_bRemoving = false;
+	m_iDragIndex = -1;
+	m_iObjectIndex = -1;
+	m_iActiveIndex = -1;
+	m_iControllerLevel = -1;
+	m_iCollisionCount = 0;
+	m_iIslandQuietTicks = 0;
+	m_iSerial = g_iNextObjectSerial++;
+	m_bFrozen = false;
+	m_bCollisionEvents = true;
+	m_ccdMode = PHYSICS_CCD_DEFAULT;
+	m_bCCDSpeculative = false;
 }
 
 CPhysicsObject::~CPhysicsObject() {
 	m_bRemoving = true;
 
 	if (m_pEnv) {
+		// No point in putting the rigid body back in the world like RemoveTrigger does
+		if (m_pGhostObject)
+			DestroyGhostObject();
+
 		CPhysicsObject::RemoveShadowController();
 		m_pEnv->GetDragController()->RemovePhysicsObject(this);
 
@@ -88,21 +111,24 @@ CPhysicsObject::~CPhysicsObject() {
 	for (int i = 0; i < m_pEventListeners.Count(); i++) {
 		m_pEventListeners[i]->ObjectDestroyed(this);
 	}
-	
-	if (m_pName)
-		delete [] m_pName;
+
+	if (m_pObject && !m_bIsSphere)
+		GetCollide()->RemoveObjectRef();
 
 	if (m_pEnv && m_pObject) {
 		// Don't change this. This will eventually pan out to removeRigidBody.
 		// Using removeCollisionObject because of a certain soft body fix.
 		m_pEnv->GetBulletEnvironment()->removeCollisionObject(m_pObject);
+	}
 
+	if (m_pObject) {
 		// Sphere collision shape is allocated when we're a sphere. Delete it.
 		if (m_bIsSphere)
 			delete (btSphereShape *)m_pObject->getCollisionShape();
 
-		delete m_pObject->getMotionState();
-		delete m_pObject;
+		// The rigid body and motion state live in the same pool block as us, see CPhysicsObjectPool
+		m_pObject->getMotionState()->~btMotionState();
+		m_pObject->~btRigidBody();
 	}
 }
 
@@ -255,6 +281,16 @@ void CPhysicsObject::Wake() {
 		return;
 
 	m_pObject->setDeactivationTime(0);
+
+	// Frozen by the performance limits, see CPhysicsEnvironment::FreezeObject. The solver may have
+	// written velocities into us while we weren't being integrated.
+	if (m_pObject->getActivationState() == DISABLE_SIMULATION) {
+		m_pObject->setLinearVelocity(btVector3(0, 0, 0));
+		m_pObject->setAngularVelocity(btVector3(0, 0, 0));
+		m_pObject->forceActivationState(ACTIVE_TAG);
+		return;
+	}
+
 	m_pObject->setActivationState(ACTIVE_TAG);
 }
 
@@ -395,6 +431,9 @@ void CPhysicsObject::SetDragCoefficient(float *pDrag, float *pAngularDrag) {
 
 	if (pAngularDrag)
 		m_angDragCoefficient = *pAngularDrag;
+
+	if (IsDragEnabled())
+		m_pEnv->GetDragController()->UpdateDragBasis(this);
 }
 
 void CPhysicsObject::SetBuoyancyRatio(float ratio) {
@@ -419,6 +458,8 @@ void CPhysicsObject::SetMaterialIndex(int materialIndex) {
 		// ratio = (mass / volume) / density
 		// or (actual density) / (prop density)
 		m_fBuoyancyRatio = SAFE_DIVIDE(SAFE_DIVIDE(m_fMass, m_fVolume), pSurface->physics.density);
+
+		UpdateCCD();
 	}
 }
 
@@ -519,6 +560,37 @@ void CPhysicsObject::GetPositionMatrix(matrix3x4_t *positionMatrix) const {
 	ConvertMatrixToHL(transform, *positionMatrix);
 }
 
+// Where we are at render time: between the last two simulated steps, based on how far the environment's
+// clock is into the next step. Trails the simulation by up to a step, like bullet's latency interpolation.
+static void GetInterpolatedTransform(const btRigidBody *pBody, const CPhysicsEnvironment *pEnv, btTransform &transform) {
+	((btMassCenterMotionState *)pBody->getMotionState())->getGraphicTransform(transform);
+	if (!pBody->isActive() || pBody->isStaticOrKinematicObject())
+		return;
+
+	const btScalar t = pEnv->GetInterpolationTime() - pEnv->GetSimulationTimestep();
+
+	btTransform interpolated;
+	btTransformUtil::integrateTransform(pBody->getWorldTransform(), pBody->getLinearVelocity(), pBody->getAngularVelocity(), t, interpolated);
+	transform = interpolated * ((btMassCenterMotionState *)pBody->getMotionState())->m_centerOfMassOffset.inverse();
+}
+
+void CPhysicsObject::GetInterpolatedPosition(Vector *worldPosition, QAngle *angles) const {
+	if (!worldPosition && !angles) return;
+
+	btTransform transform;
+	GetInterpolatedTransform(m_pObject, m_pEnv, transform);
+	if (worldPosition) ConvertPosToHL(transform.getOrigin(), *worldPosition);
+	if (angles) ConvertRotationToHL(transform.getBasis(), *angles);
+}
+
+void CPhysicsObject::GetInterpolatedPositionMatrix(matrix3x4_t *positionMatrix) const {
+	if (!positionMatrix) return;
+
+	btTransform transform;
+	GetInterpolatedTransform(m_pObject, m_pEnv, transform);
+	ConvertMatrixToHL(transform, *positionMatrix);
+}
+
 void CPhysicsObject::SetVelocity(const Vector *velocity, const AngularImpulse *angularVelocity) {
 	if (!velocity && !angularVelocity) return;
 
@@ -860,7 +932,7 @@ void CPhysicsObject::UpdateShadow(const Vector &targetPosition, const QAngle &ta
 
 int CPhysicsObject::GetShadowPosition(Vector *position, QAngle *angles) const {
 	// Valve vphysics just interpolates current position to next PSI
-	if (!position && !angles) return m_pEnv->GetNumSubSteps();
+	if (!position && !angles) return m_pEnv->GetNumSteps();
 
 	btTransform transform;
 	((btMassCenterMotionState *)m_pObject->getMotionState())->getGraphicTransform(transform);
@@ -874,8 +946,8 @@ int CPhysicsObject::GetShadowPosition(Vector *position, QAngle *angles) const {
 	if (angles)
 		ConvertRotationToHL(transform.getBasis(), *angles);
 
-	// Simulated PSIs
-	return m_pEnv->GetNumSubSteps();
+	// Simulated PSIs, in the steps the game sees (substeps don't count). 0 on frames that didn't step, like Valve's
+	return m_pEnv->GetNumSteps();
 }
 
 IPhysicsShadowController *CPhysicsObject::GetShadowController() const {
@@ -908,6 +980,8 @@ void CPhysicsObject::UpdateCollide() {
 
 	m_pObject->setMassProps(m_fMass, inertia);
 	m_pObject->updateInertiaTensor();
+
+	UpdateCCD();
 }
 
 const CPhysCollide *CPhysicsObject::GetCollide() const {
@@ -921,6 +995,15 @@ CPhysCollide *CPhysicsObject::GetCollide() {
 void CPhysicsObject::SetCollide(CPhysCollide *pCollide) {
 	m_pEnv->GetBulletEnvironment()->removeRigidBody(m_pObject);
 
+	// Spheres own their shape, anything else came from the collision interface
+	if (m_bIsSphere) {
+		delete (btSphereShape *)m_pObject->getCollisionShape();
+		m_bIsSphere = false;
+	} else {
+		GetCollide()->RemoveObjectRef();
+	}
+	pCollide->AddObjectRef();
+
 	btCollisionShape *pShape = pCollide->GetCollisionShape();
 	m_pObject->setCollisionShape(pShape);
 
@@ -930,10 +1013,51 @@ void CPhysicsObject::SetCollide(CPhysCollide *pCollide) {
 	m_pObject->setMassProps(m_fMass, inertia);
 	m_pObject->updateInertiaTensor();
 
+	UpdateCCD();
+
 	// Remove/add object to update contact points
 	m_pEnv->GetBulletEnvironment()->addRigidBody(m_pObject);
 }
 
+void CPhysicsObject::SetCCDMode(physics_ccdmode_t mode) {
+	if (mode < 0 || mode >= PHYSICS_CCD_COUNT) return;
+
+	m_ccdMode = mode;
+	UpdateCCD();
+}
+
+// UNEXPOSED
+// Purpose: Bullet sweeps a body on steps where it moves further than its motion threshold. Tie that to our
+// smallest extent so slow debris never pays for a sweep, and only objects that could actually pass through
+// something in one step get one. Bullet skips compound shapes, see CPhysicsEnvironment::SweepCompoundObjects
+// and CPhysicsEnvironment::CreateSpeculativeContacts.
+void CPhysicsObject::UpdateCCD() {
+	const physics_ccdmode_t mode = m_ccdMode != PHYSICS_CCD_DEFAULT ? m_ccdMode : g_SurfaceDatabase.GetCCDMode(m_materialIndex);
+	const btCollisionShape *pShape = m_pObject->getCollisionShape();
+	m_bCCDSpeculative = mode == PHYSICS_CCD_SPECULATIVE;
+
+	// A threshold of 0 disables CCD
+	if (IsStatic() || !pShape || mode == PHYSICS_CCD_DISABLED) {
+		m_pObject->setCcdMotionThreshold(0);
+		m_pObject->setCcdSweptSphereRadius(0);
+		return;
+	}
+
+	btVector3 mins, maxs;
+	pShape->getAabb(btTransform::getIdentity(), mins, maxs);
+	const btVector3 extents = maxs - mins;
+	const btScalar minExtent = extents[extents.minAxis()];
+
+	// Small enough to fit inside of us, so the sweep only stops on things we'd really hit
+	m_pObject->setCcdSweptSphereRadius(minExtent * btScalar(0.4));
+
+	btScalar threshold = 1e-7;
+	if (mode != PHYSICS_CCD_ALWAYS)
+		threshold = btMax(threshold, minExtent * m_pEnv->GetCCDMotionFraction());
+
+	m_pObject->setCcdMotionThreshold(threshold);
+}
+
 const char *CPhysicsObject::GetName() const {
 	return m_pName;
 }
@@ -982,6 +1106,10 @@ void CPhysicsObject::RemoveTrigger() {
 	else
 		m_pEnv->GetBulletEnvironment()->addRigidBody(m_pObject);
 
+	DestroyGhostObject();
+}
+
+void CPhysicsObject::DestroyGhostObject() {
 	m_pGhostObject->setCallback(NULL);
 	delete m_pGhostCallback;
 	m_pGhostCallback = NULL;
@@ -989,15 +1117,77 @@ void CPhysicsObject::RemoveTrigger() {
 	m_pEnv->GetBulletEnvironment()->removeCollisionObject(m_pGhostObject);
 	delete m_pGhostObject;
 	m_pGhostObject = NULL;
+
+	m_triggerOverlaps.RemoveAll();
+	m_pEnv->RemoveDirtyTrigger(this);
 }
 
+// Called by the ghost callback from inside the broadphase, which is no place to call the game from.
+// We only get queued up here, the environment diffs our overlaps and dispatches the events after the step.
 void CPhysicsObject::TriggerObjectEntered(CPhysicsObject *pObject) {
-	// Doesn't work.
-	//m_pEnv->HandleObjectEnteredTrigger(this, pObject);
+	m_pEnv->MarkTriggerDirty(this);
 }
 
 void CPhysicsObject::TriggerObjectExited(CPhysicsObject *pObject) {
-	//m_pEnv->HandleObjectExitedTrigger(this, pObject);
+	if (pObject->IsBeingRemoved()) {
+		// Going away for good, so it can't be left in our set until the next diff
+		for (int i = 0; i < m_triggerOverlaps.Count(); i++) {
+			if (m_triggerOverlaps[i] == pObject) {
+				m_triggerOverlaps.Remove(i);
+				break;
+			}
+		}
+
+		return;
+	}
+
+	m_pEnv->MarkTriggerDirty(this);
+}
+
+static int CompareObjectSerials(CPhysicsObject *const *a, CPhysicsObject *const *b) {
+	const unsigned int serialA = (*a)->GetSerial();
+	const unsigned int serialB = (*b)->GetSerial();
+	if (serialA == serialB) return 0;
+
+	return serialA < serialB ? -1 : 1;
+}
+
+// UNEXPOSED
+// Purpose: Bring our overlap set up to date with the ghost object's and append the objects that entered and exited
+// since the last update. Both sets are sorted by serial, so this is a single merge over them.
+void CPhysicsObject::UpdateTriggerOverlaps(CUtlVector<CPhysicsObject *> &scratch, CUtlVector<CPhysicsObject *> &entered, CUtlVector<CPhysicsObject *> &exited) {
+	scratch.RemoveAll();
+
+	const int numOverlapping = m_pGhostObject->getNumOverlappingObjects();
+	for (int i = 0; i < numOverlapping; i++) {
+		btCollisionObject *pColObj = m_pGhostObject->getOverlappingObject(i);
+
+		// Other triggers and fluids
+		if (pColObj->getInternalType() == btCollisionObject::CO_GHOST_OBJECT)
+			continue;
+
+		CPhysicsObject *pObject = static_cast<CPhysicsObject *>(pColObj->getUserPointer());
+		if (!pObject || pObject->IsBeingRemoved())
+			continue;
+
+		scratch.AddToTail(pObject);
+	}
+
+	scratch.Sort(CompareObjectSerials);
+
+	int oldIndex = 0, newIndex = 0;
+	while (oldIndex < m_triggerOverlaps.Count() || newIndex < scratch.Count()) {
+		if (newIndex == scratch.Count() || (oldIndex < m_triggerOverlaps.Count() && m_triggerOverlaps[oldIndex]->GetSerial() < scratch[newIndex]->GetSerial())) {
+			exited.AddToTail(m_triggerOverlaps[oldIndex++]);
+		} else if (oldIndex == m_triggerOverlaps.Count() || scratch[newIndex]->GetSerial() < m_triggerOverlaps[oldIndex]->GetSerial()) {
+			entered.AddToTail(scratch[newIndex++]);
+		} else {
+			oldIndex++;
+			newIndex++;
+		}
+	}
+
+	m_triggerOverlaps.Swap(scratch);
 }
 
 void CPhysicsObject::BecomeHinged(int localAxis) {
@@ -1092,24 +1282,22 @@ void CPhysicsObject::Init(CPhysicsEnvironment *pEnv, btRigidBody *pObject, int m
 	m_iLastActivationState = -1;
 
 	m_pObject->setUserPointer(this);
+	m_pObject->setCollisionFlags(m_pObject->getCollisionFlags() | btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK); // Surface pair coefficients
 	m_pObject->setSleepingThresholds(SLEEP_LINEAR_THRESHOLD, SLEEP_ANGULAR_THRESHOLD);
 	m_pObject->setActivationState(ISLAND_SLEEPING); // All objects start asleep.
 
+	if (!isSphere)
+		GetCollide()->AddObjectRef();
+
 	if (pParams) {
 		m_pGameData		= pParams->pGameData;
 		m_fVolume		= pParams->volume * CUBIC_METERS_PER_CUBIC_INCH;
 		EnableCollisions(pParams->enableCollisions);
 
 		// Name must be copied because the game may use temporary memory to give it to us.
-		if (pParams->pName) {
-			int len = strlen(pParams->pName);
-
-			if (len > 0) {
-				m_pName = new char[len + 1];
-				strcpy(m_pName, pParams->pName);
-				m_pName[len] = 0;
-			}
-		}
+		// Thousands of gibs share a handful of names, so keep one copy of each.
+		if (pParams->pName && pParams->pName[0])
+			m_pName = g_ObjectNames.String(g_ObjectNames.AddString(pParams->pName));
 
 		m_pObject->setDebugName(m_pName);
 	}
@@ -1136,32 +1324,12 @@ void CPhysicsObject::Init(CPhysicsEnvironment *pEnv, btRigidBody *pObject, int m
 
 	ComputeDragBasis(isStatic);
 
-	if (!isStatic && drag != 0.0f) {
-		EnableDrag(true);
-	}
-
+	// Coefficients first, the drag controller packs them when the object is added
 	m_dragCoefficient = drag;
 	m_angDragCoefficient = angDrag;
 
-	// Compute our continuous collision detection stuff (for fast moving objects, prevents tunneling)
-	// This doesn't work on compound objects! see: btDiscreteDynamicsWorld::integrateTransforms
-	// TODO: Add support for object specific CCD enable/disable. We only want objects able to move very fast use CCD
-	if (!isStatic) 
-	{
-		btScalar radius(1.0);
-		if (m_pObject->getCollisionShape()) {
-			btVector3 center;
-			m_pObject->getCollisionShape()->getBoundingSphere(center, radius);
-		}
-
-		m_pObject->setCcdMotionThreshold(1e-7);
-		m_pObject->setCcdSweptSphereRadius(radius * 0.2);
-	}
-	else
-	{
-		// Disable CCD
-		m_pObject->setCcdMotionThreshold(10000.0f);
-		m_pObject->setCcdSweptSphereRadius(0.0f);
+	if (!isStatic && drag != 0.0f) {
+		EnableDrag(true);
 	}
 
 	if (isStatic) 
@@ -1173,6 +1341,9 @@ void CPhysicsObject::Init(CPhysicsEnvironment *pEnv, btRigidBody *pObject, int m
 	{
 		m_pEnv->GetBulletEnvironment()->addRigidBody(m_pObject);
 	}
+
+	// Compute our continuous collision detection stuff (for fast moving objects, prevents tunneling)
+	UpdateCCD();
 }
 
 // UNEXPOSED
@@ -1285,7 +1456,6 @@ CPhysicsObject *CreatePhysicsObject(CPhysicsEnvironment *pEnvironment, const CPh
 
 	btTransform massCenterTrans = btTransform::getIdentity();
 	massCenterTrans.setOrigin(pCollisionModel->GetMassCenter());
-	btMassCenterMotionState *pMotionState = new btMassCenterMotionState(massCenterTrans);
 
 	btVector3 bullPos;
 	btMatrix3x3 bullMatrix;
@@ -1293,7 +1463,6 @@ CPhysicsObject *CreatePhysicsObject(CPhysicsEnvironment *pEnvironment, const CPh
 	ConvertRotationToBull(angles, bullMatrix);
 
 	btTransform initialWordTrans(bullMatrix, bullPos);
-	pMotionState->setGraphicTransform(initialWordTrans);
 
 	// Grab some parameters
 	btScalar mass = 0.f;
@@ -1314,10 +1483,10 @@ CPhysicsObject *CreatePhysicsObject(CPhysicsEnvironment *pEnvironment, const CPh
 		//inertia *= inertiaCoeff * mass;
 	}
 
-	btRigidBody::btRigidBodyConstructionInfo info(mass, pMotionState, pShape, inertia);
-	btRigidBody *pBody = new btRigidBody(info);
+	btRigidBody::btRigidBodyConstructionInfo info(mass, NULL, pShape, inertia);
+	btRigidBody *pBody;
 
-	CPhysicsObject *pObject = new CPhysicsObject();
+	CPhysicsObject *pObject = pEnvironment->GetObjectPool()->CreateObject(info, massCenterTrans, initialWordTrans, &pBody);
 	pObject->Init(pEnvironment, pBody, materialIndex, pParams, isStatic);
 
 	return pObject;
@@ -1350,13 +1519,10 @@ CPhysicsObject *CreatePhysicsSphere(CPhysicsEnvironment *pEnvironment, float rad
 		}
 	}
 
-	btMassCenterMotionState *motionstate = new btMassCenterMotionState();
-	motionstate->setGraphicTransform(transform);
-	btRigidBody::btRigidBodyConstructionInfo info(mass, motionstate, shape);
-
-	btRigidBody *body = new btRigidBody(info);
+	btRigidBody::btRigidBodyConstructionInfo info(mass, NULL, shape);
+	btRigidBody *body;
 
-	CPhysicsObject *pObject = new CPhysicsObject;
+	CPhysicsObject *pObject = pEnvironment->GetObjectPool()->CreateObject(info, btTransform::getIdentity(), transform, &body);
 	pObject->Init(pEnvironment, body, materialIndex, pParams, isStatic, true);
 
 	return pObject;
@@ -4,6 +4,8 @@
 	#pragma once
 #endif
 
+#include <atomic>
+
 class CPhysicsEnvironment;
 class CPhysicsVehicleController;
 class CShadowController;
@@ -106,6 +108,14 @@ class CPhysicsObject : public IPhysicsObject32 {
 		void								SetPositionMatrix(const matrix3x4_t&matrix, bool isTeleport);
 		void								GetPosition(Vector *worldPosition, QAngle *angles) const;
 		void								GetPositionMatrix(matrix3x4_t *positionMatrix) const;
+		void								GetInterpolatedPosition(Vector *worldPosition, QAngle *angles) const;
+		void								GetInterpolatedPositionMatrix(matrix3x4_t *positionMatrix) const;
+
+		void								EnableCollisionEvents(bool enable) { m_bCollisionEvents = enable; }
+		bool								IsCollisionEventsEnabled() const { return m_bCollisionEvents; }
+
+		void								SetCCDMode(physics_ccdmode_t mode);
+		physics_ccdmode_t					GetCCDMode() const { return m_ccdMode; }
 
 		void								SetVelocity(const Vector *velocity, const AngularImpulse *angularVelocity);
 		void								SetVelocityInstantaneous(const Vector *velocity, const AngularImpulse *angularVelocity);
@@ -186,11 +196,60 @@ class CPhysicsObject : public IPhysicsObject32 {
 		float								GetAngularDragInDirection(const btVector3 &direction) const;
 		void								ComputeDragBasis(bool isStatic);
 
+		const btVector3 &					GetDragBasis() const { return m_dragBasis; }
+		const btVector3 &					GetAngularDragBasis() const { return m_angDragBasis; }
+		float								GetDragCoefficient() const { return m_dragCoefficient; }
+		float								GetAngularDragCoefficient() const { return m_angDragCoefficient; }
+
+		// Slot in the drag controller's object list, -1 if drag is disabled
+		int									GetDragIndex() const { return m_iDragIndex; }
+		void								SetDragIndex(int index) { m_iDragIndex = index; }
+
+		// Slot in the environment's object list
+		int									GetObjectIndex() const { return m_iObjectIndex; }
+		void								SetObjectIndex(int index) { m_iObjectIndex = index; }
+
+		// Slot in the object tracker's active list, -1 if we aren't in it
+		int									GetActiveIndex() const { return m_iActiveIndex; }
+		void								SetActiveIndex(int index) { m_iActiveIndex = index; }
+
+		// Scratch value used by the environment while batching controllers
+		int									GetControllerLevel() const { return m_iControllerLevel; }
+		void								SetControllerLevel(int level) { m_iControllerLevel = level; }
+
+		// New contact points this timestep, see physics_performanceparams_t::maxCollisionsPerObjectPerTimestep.
+		// Counted from the narrowphase, so this can be bumped from several threads at once.
+		void								AddCollision() { m_iCollisionCount++; }
+		int									GetCollisionCount() const { return m_iCollisionCount; }
+		void								SetCollisionCount(int count) { m_iCollisionCount = count; }
+
+		// Set when the environment froze us for going over the performance limits, see CPlayerController::WasFrozen
+		bool								IsFrozen() const { return m_bFrozen; }
+		void								SetFrozen(bool frozen) { m_bFrozen = frozen; }
+
+		// Steps our island has spent under its sleep threshold, see CPhysicsEnvironment::UpdateIslandSleep
+		int									GetIslandQuietTicks() const { return m_iIslandQuietTicks; }
+		void								SetIslandQuietTicks(int ticks) { m_iIslandQuietTicks = ticks; }
+
+		// Unique for the lifetime of the process, unlike our address (the object pool reuses blocks)
+		unsigned int						GetSerial() const { return m_iSerial; }
+
+		// Recomputes our CCD threshold and swept sphere from our shape, material and mode
+		void								UpdateCCD();
+
+		// Set when we're in PHYSICS_CCD_SPECULATIVE, see CPhysicsEnvironment::CreateSpeculativeContacts
+		bool								IsCCDSpeculative() const { return m_bCCDSpeculative; }
+
 		float								GetVolume() const { return m_fVolume; }
 		float								GetBuoyancyRatio() const { return m_fBuoyancyRatio; } // [0..1] value
 
 		void								TriggerObjectEntered(CPhysicsObject *pObject);
 		void								TriggerObjectExited(CPhysicsObject *pObject);
+		void								UpdateTriggerOverlaps(CUtlVector<CPhysicsObject *> &scratch, CUtlVector<CPhysicsObject *> &entered, CUtlVector<CPhysicsObject *> &exited);
+
+		// Set while we're in the environment's list of triggers to update, see CPhysicsEnvironment::UpdateTriggers
+		bool								IsTriggerDirty() const { return m_bTriggerDirty; }
+		void								SetTriggerDirty(bool dirty) { m_bTriggerDirty = dirty; }
 
 		btVector3							GetBullMassCenterOffset() const;
 
@@ -200,6 +259,11 @@ class CPhysicsObject : public IPhysicsObject32 {
 		CPhysicsFluidController *			GetFluidController() { return m_pFluidController; }
 		void								SetFluidController(CPhysicsFluidController *controller) { m_pFluidController = controller; }
 
+		// Fluids whose volume we're in, maintained by the fluids
+		const CUtlVector<CPhysicsFluidController *> &GetTouchingFluids() const { return m_touchingFluids; }
+		void								AddTouchingFluid(CPhysicsFluidController *pFluid) { m_touchingFluids.AddToTail(pFluid); }
+		void								RemoveTouchingFluid(CPhysicsFluidController *pFluid) { m_touchingFluids.FindAndFastRemove(pFluid); }
+
 		void								SetVehicleController(CPhysicsVehicleController *pController) { m_pVehicleController = pController; }
 
 		bool								IsBeingRemoved() { return m_bRemoving; }
@@ -207,13 +271,17 @@ class CPhysicsObject : public IPhysicsObject32 {
 		void								TransferToEnvironment(CPhysicsEnvironment *pDest);
 
 	private:
+		void								DestroyGhostObject();
+
 		CPhysicsEnvironment *				m_pEnv;
 		void *								m_pGameData;
 		btRigidBody *						m_pObject;
-		char *								m_pName;
+		const char *						m_pName;
 
 		btGhostObject *						m_pGhostObject; // For triggers
 		btGhostObjectCallback *				m_pGhostCallback;
+		CUtlVector<CPhysicsObject *>		m_triggerOverlaps; // Objects the game knows are in us, sorted by serial
+		bool								m_bTriggerDirty;
 
 		unsigned int						m_materialIndex;
 		unsigned short						m_callbacks;
@@ -235,11 +303,23 @@ class CPhysicsObject : public IPhysicsObject32 {
 		CShadowController *					m_pShadow;
 		CPhysicsVehicleController *			m_pVehicleController;
 		CPhysicsFluidController *			m_pFluidController;
+		CUtlVector<CPhysicsFluidController *> m_touchingFluids;
 		CUtlVector<CPhysicsConstraint *>	m_pConstraintVec;
 		CUtlVector<IController *>			m_pControllers;
 		CUtlVector<IObjectEventListener *>	m_pEventListeners;
 
 		int									m_iLastActivationState;
+		int									m_iDragIndex;
+		int									m_iObjectIndex;
+		int									m_iActiveIndex;
+		int									m_iControllerLevel;
+		std::atomic<int>					m_iCollisionCount;
+		int									m_iIslandQuietTicks;
+		unsigned int						m_iSerial;
+		physics_ccdmode_t					m_ccdMode;
+		bool								m_bFrozen;
+		bool								m_bCollisionEvents;
+		bool								m_bCCDSpeculative;
 };
 
 CPhysicsObject *CreatePhysicsObject(CPhysicsEnvironment *pEnvironment, const CPhysCollide *pCollisionModel, int materialIndex, const Vector &position, const QAngle &angles, objectparams_t *pParams, bool isStatic);
@@ -0,0 +1,104 @@
+#include "StdAfx.h"
+
+#include "Physics_ObjectPool.h"
+#include "Physics_Object.h"
+
+// NOTE: No memdbgon here, it redefines new and breaks the placement news below.
+
+// Block layout, hottest data first. The header is only touched on alloc/free.
+struct objectblockheader_t {
+	CPhysicsObjectPool *	pPool;
+	void *					pNextFree;
+};
+
+#define POOL_ALIGN(x, a) (((x) + (a) - 1) & ~((size_t)(a) - 1))
+
+static const size_t BLOCK_ALIGNMENT		= 64; // Cache line
+static const size_t BODY_OFFSET			= POOL_ALIGN(sizeof(objectblockheader_t), 16);
+static const size_t MOTIONSTATE_OFFSET	= POOL_ALIGN(BODY_OFFSET + sizeof(btRigidBody), 16);
+static const size_t OBJECT_OFFSET		= POOL_ALIGN(MOTIONSTATE_OFFSET + sizeof(btMassCenterMotionState), 16);
+static const size_t BLOCK_SIZE			= POOL_ALIGN(OBJECT_OFFSET + sizeof(CPhysicsObject), BLOCK_ALIGNMENT);
+static const int	BLOCKS_PER_SLAB		= 64;
+
+static inline objectblockheader_t *GetHeader(void *pBlock) {
+	return (objectblockheader_t *)pBlock;
+}
+
+/*****************************
+* CLASS CPhysicsObjectPool
+*****************************/
+
+CPhysicsObjectPool::CPhysicsObjectPool() {
+	m_pFreeList = NULL;
+	m_numLive = 0;
+	m_bReleased = false;
+}
+
+CPhysicsObjectPool::~CPhysicsObjectPool() {
+	Assert(m_numLive == 0);
+
+	for (int i = 0; i < m_slabs.Count(); i++)
+		btAlignedFree(m_slabs[i]);
+}
+
+CPhysicsObject *CPhysicsObjectPool::CreateObject(btRigidBody::btRigidBodyConstructionInfo &info, const btTransform &massCenterOffset, const btTransform &graphicTransform, btRigidBody **ppBody) {
+	char *pBlock = (char *)AllocBlock();
+
+	btMassCenterMotionState *pMotionState = new (pBlock + MOTIONSTATE_OFFSET) btMassCenterMotionState(massCenterOffset);
+	pMotionState->setGraphicTransform(graphicTransform);
+
+	info.m_motionState = pMotionState;
+	*ppBody = new (pBlock + BODY_OFFSET) btRigidBody(info);
+
+	return new (pBlock + OBJECT_OFFSET) CPhysicsObject;
+}
+
+void CPhysicsObjectPool::DestroyObject(CPhysicsObject *pObject) {
+	if (!pObject) return;
+
+	// The destructor takes care of the rigid body and motion state
+	void *pBlock = (char *)pObject - OBJECT_OFFSET;
+	pObject->~CPhysicsObject();
+
+	GetHeader(pBlock)->pPool->FreeBlock(pBlock);
+}
+
+void CPhysicsObjectPool::Release() {
+	m_bReleased = true;
+	if (m_numLive == 0)
+		delete this;
+}
+
+void *CPhysicsObjectPool::AllocBlock() {
+	if (!m_pFreeList) {
+		char *pSlab = (char *)btAlignedAlloc(BLOCK_SIZE * BLOCKS_PER_SLAB, BLOCK_ALIGNMENT);
+		m_slabs.AddToTail(pSlab);
+
+		// Thread the new blocks onto the free list back to front so they're handed out in address order
+		for (int i = BLOCKS_PER_SLAB - 1; i >= 0; i--) {
+			void *pBlock = pSlab + i * BLOCK_SIZE;
+			GetHeader(pBlock)->pPool = this;
+			GetHeader(pBlock)->pNextFree = m_pFreeList;
+			m_pFreeList = pBlock;
+		}
+	}
+
+	void *pBlock = m_pFreeList;
+	m_pFreeList = GetHeader(pBlock)->pNextFree;
+	GetHeader(pBlock)->pNextFree = NULL;
+	m_numLive++;
+
+	return pBlock;
+}
+
+void CPhysicsObjectPool::FreeBlock(void *pBlock) {
+	Assert(GetHeader(pBlock)->pPool == this && m_numLive > 0);
+
+	// LIFO, the block we just freed is the one most likely to still be in cache
+	GetHeader(pBlock)->pNextFree = m_pFreeList;
+	m_pFreeList = pBlock;
+	m_numLive--;
+
+	if (m_bReleased && m_numLive == 0)
+		delete this;
+}
@@ -0,0 +1,43 @@
+#ifndef PHYSICS_OBJECTPOOL_H
+#define PHYSICS_OBJECTPOOL_H
+#if defined(_MSC_VER) || (defined(__GNUC__) && __GNUC__ > 3)
+	#pragma once
+#endif
+
+class CPhysicsObject;
+
+// Slab allocator owned by a single environment. Every block holds a btRigidBody, its btMassCenterMotionState
+// and the CPhysicsObject wrapping them back to back, so the simulation touches one cache aligned block per
+// object and spawning and destroying debris doesn't fragment the heap. Freed blocks are reused before new
+// slabs are allocated, and slabs are never returned until the pool is released.
+class CPhysicsObjectPool {
+	public:
+								CPhysicsObjectPool();
+
+		// Construct a motion state, rigid body and (uninitialized) physics object in a new block.
+		// info.m_motionState is filled in, graphicTransform is where the object starts out.
+		CPhysicsObject *		CreateObject(btRigidBody::btRigidBodyConstructionInfo &info, const btTransform &massCenterOffset, const btTransform &graphicTransform, btRigidBody **ppBody);
+
+		// Destruct a pooled object and hand its block back to the pool it came from.
+		// Objects can outlive the environment that created them by being transferred.
+		static void				DestroyObject(CPhysicsObject *pObject);
+
+		// Call instead of delete. The slabs are freed once the last block has been returned.
+		void					Release();
+
+		int						GetNumLiveBlocks() const { return m_numLive; }
+		int						GetNumSlabs() const { return m_slabs.Count(); }
+
+	private:
+								~CPhysicsObjectPool();
+
+		void *					AllocBlock();
+		void					FreeBlock(void *pBlock);
+
+		CUtlVector<void *>		m_slabs;
+		void *					m_pFreeList;
+		int						m_numLive;
+		bool					m_bReleased;
+};
+
+#endif // PHYSICS_OBJECTPOOL_H
@@ -284,11 +284,6 @@ void CPlayerController::Tick(float deltaTime) {
 	if (!m_enable)
 		return;
 
-	// HACK: Only run this controller once per step (until I can figure out the math to fix per-tick simulation)
-	if (m_pEnv->GetCurSubStep() != 0)
-		return;
-	deltaTime *= m_pEnv->GetNumSubSteps();
-
 	btRigidBody *body = m_pObject->GetObject();
 	btMassCenterMotionState *motionState = (btMassCenterMotionState *)body->getMotionState();
 
@@ -431,12 +426,13 @@ float CPlayerController::GetPushSpeedLimit() {
 }
 
 bool CPlayerController::WasFrozen() {
-	// Appears that if we were frozen, the game will try and update our position to the player's current position.
-	// Probably used for when the controller object is frozen due to performance limits (max collisions per timestep, etc)
-	// TODO: Implement this if we ever implement performance limitations
+	// If we were frozen due to performance limits (max collisions per timestep, etc), the game will
+	// update our position to the player's current position. Only report it once.
+	if (!m_pObject || !m_pObject->IsFrozen())
+		return false;
 
-	//NOT_IMPLEMENTED
-	return false;
+	m_pObject->SetFrozen(false);
+	return true;
 }
 
 /***********************
@@ -48,6 +48,9 @@ class CPlayerController : public IController, public IPhysicsPlayerController, p
 		void							Tick(float deltaTime);
 		void							ObjectDestroyed(CPhysicsObject *pObject);
 
+		// Drives the body towards the target over a whole step, running it per substep would overshoot
+		controllerschedule_t			GetSchedule() const { return CONTROLLER_SCHEDULE_STEP; }
+
 	private:
 		void							AttachObject();
 		void							DetachObject();
@@ -138,6 +138,9 @@ CShadowController::~CShadowController() {
 
 // UNEXPOSED
 void CShadowController::Tick(float deltaTime) {
+	// Our object was destroyed, we stick around until the game removes us
+	if (!m_pObject) return;
+
 	if (m_enable) {
 		if (IsPhysicallyControlled()) {
 			ComputeShadowControllerBull(m_pObject->GetObject(), m_shadow, m_secondsToArrival, deltaTime);
@@ -154,7 +157,9 @@ void CShadowController::Tick(float deltaTime) {
 		m_shadow.lastPosition.setZero();
 	}
 
-	m_ticksSinceUpdate++;
+	// Runs every substep for smooth control, but the game counts in steps
+	if (m_pObject->GetVPhysicsEnvironment()->IsFirstSubStep())
+		m_ticksSinceUpdate++;
 }
 
 void CShadowController::ObjectDestroyed(CPhysicsObject *pObject) {
@@ -359,6 +364,14 @@ void CShadowController::DetachObject() {
 	m_pObject = NULL;
 }
 
+// UNEXPOSED
+int CShadowController::GetControlledObjects(CPhysicsObject **pObjects, int maxObjects) const {
+	if (!m_pObject || maxObjects < 1) return 0;
+
+	pObjects[0] = m_pObject;
+	return 1;
+}
+
 int CShadowController::GetTicksSinceUpdate() {
 	return m_ticksSinceUpdate;
 }
@@ -54,6 +54,9 @@ class CShadowController : public IController, public IPhysicsShadowController, p
 
 		void					ObjectDestroyed(CPhysicsObject *pObject);
 
+		bool					IsThreadSafe() const { return true; }
+		int						GetControlledObjects(CPhysicsObject **pObjects, int maxObjects) const;
+
 		int						GetTicksSinceUpdate();
 	private:
 		void					AttachObject();
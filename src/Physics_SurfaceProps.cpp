@@ -3,6 +3,7 @@
 #include <tier1/KeyValues.h>
 
 #include "Physics_SurfaceProps.h"
+#include "convert.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -13,6 +14,8 @@
 
 CPhysicsSurfaceProps::CPhysicsSurfaceProps() {
 	m_strings = new CUtlSymbolTable(0, 32, true);
+	m_defaultIndex = -1;
+	m_pairTableSize = 0;
 
 	// HACK: Prevent sound list from starting at index 0 (invalid index)
 	m_soundList.AddToHead();
@@ -44,8 +47,11 @@ int CPhysicsSurfaceProps::ParseSurfaceData(const char *pFilename, const char *pT
 		prop.data.game.maxSpeedFactor = 1.0f;
 		prop.data.game.jumpFactor = 1.0f;
 		prop.data.game.climbable = 0.0f;
+		prop.m_ccdMode = PHYSICS_CCD_DEFAULT;
 
-		int baseMaterial = GetSurfaceIndex("default");
+		// Every stored surface already has its base chain flattened into it,
+		// so inheriting from a base is a single lookup + copy.
+		int baseMaterial = m_defaultIndex;
 		if (baseMaterial != -1) {
 			CopyPhysicsProperties(&prop, baseMaterial);
 
@@ -125,13 +131,31 @@ int CPhysicsSurfaceProps::ParseSurfaceData(const char *pFilename, const char *pT
 			} else if (!Q_stricmp(key, "rolling") || !Q_stricmp(key, "roll")) {
 				CUtlSymbol sym = m_strings->AddString(data->GetString());
 				prop.data.sounds.rolling = FindOrAddSound(sym);
+			} else if (!Q_stricmp(key, "ccd")) {
+				const char *pMode = data->GetString();
+				if (!Q_stricmp(pMode, "auto"))
+					prop.m_ccdMode = PHYSICS_CCD_AUTO;
+				else if (!Q_stricmp(pMode, "off"))
+					prop.m_ccdMode = PHYSICS_CCD_DISABLED;
+				else if (!Q_stricmp(pMode, "always"))
+					prop.m_ccdMode = PHYSICS_CCD_ALWAYS;
+				else if (!Q_stricmp(pMode, "speculative"))
+					prop.m_ccdMode = PHYSICS_CCD_SPECULATIVE;
+				else
+					DevWarning("VPhysics: Surfaceprop \"%s\" has unknown ccd mode %s\n", surface->GetName(), pMode);
 			} else
 				DevWarning("VPhysics: Surfaceprop \"%s\" has unknown key %s (data: %s)\n", surface->GetName(), key, data->GetString());
 		}
 
-		m_props.AddToTail(prop);
+		const int index = m_props.AddToTail(prop);
+		m_propTable.Insert((UtlSymId_t)prop.m_name, index);
+
+		if (m_defaultIndex == -1 && !Q_stricmp(surface->GetName(), "default"))
+			m_defaultIndex = index;
 	}
 	surfprops->deleteThis();
+
+	BuildMaterialPairTable();
 	return 0;
 }
 
@@ -147,10 +171,9 @@ int CPhysicsSurfaceProps::GetSurfaceIndex(const char *pSurfacePropName) const {
 
 	CUtlSymbol id = m_strings->Find(pSurfacePropName);
 	if (id.IsValid()) {
-		for (int i = 0; i < m_props.Size(); i++) {
-			if (m_props[i].m_name == id)
-				return i;
-		}
+		UtlHashHandle_t handle = m_propTable.Find((UtlSymId_t)id);
+		if (handle != m_propTable.InvalidHandle())
+			return m_propTable.Element(handle);
 	}
 
 	return -1;
@@ -168,7 +191,7 @@ void CPhysicsSurfaceProps::GetPhysicsProperties(int surfaceDataIndex, float *den
 
 surfacedata_t *CPhysicsSurfaceProps::GetSurfaceData(int surfaceDataIndex) {
 	CSurface *pSurface = GetInternalSurface(surfaceDataIndex);
-	if (!pSurface) pSurface = GetInternalSurface(GetSurfaceIndex("default"));
+	if (!pSurface) pSurface = GetInternalSurface(m_defaultIndex);
 	Assert(pSurface);
 
 	return &pSurface->data;
@@ -189,6 +212,14 @@ const char *CPhysicsSurfaceProps::GetPropName(int surfaceDataIndex) const {
 	return m_strings->String(m_props[surfaceDataIndex].m_name);
 }
 
+// UNEXPOSED
+physics_ccdmode_t CPhysicsSurfaceProps::GetCCDMode(int surfaceDataIndex) const {
+	const CSurface *pSurface = GetInternalSurface(surfaceDataIndex);
+	if (!pSurface) return PHYSICS_CCD_DEFAULT;
+
+	return pSurface->m_ccdMode;
+}
+
 void CPhysicsSurfaceProps::SetWorldMaterialIndexTable(int *pMapArray, int mapSize) {
 	NOT_IMPLEMENTED
 }
@@ -229,6 +260,7 @@ void CPhysicsSurfaceProps::CopyPhysicsProperties(CSurface *pOut, int baseIndex)
 	const CSurface *pSurface = GetInternalSurface(baseIndex);
 	if (pSurface) {
 		pOut->data.physics = pSurface->data.physics;
+		pOut->m_ccdMode = pSurface->m_ccdMode;
 	}
 }
 
@@ -243,11 +275,39 @@ bool CPhysicsSurfaceProps::AddFileToDatabase(const char *pFilename) {
 }
 
 int CPhysicsSurfaceProps::FindOrAddSound(CUtlSymbol sym) {
-	int id = m_soundList.Find(sym);
-	if (id != -1)
-		return id;
-	else
-		return m_soundList.AddToTail(sym);
+	UtlHashHandle_t handle = m_soundTable.Find((UtlSymId_t)sym);
+	if (handle != m_soundTable.InvalidHandle())
+		return m_soundTable.Element(handle);
+
+	const int id = m_soundList.AddToTail(sym);
+	m_soundTable.Insert((UtlSymId_t)sym, id);
+	return id;
+}
+
+// Precompute the combined coefficients for every surface pair so contact creation
+// only has to do a single table lookup.
+void CPhysicsSurfaceProps::BuildMaterialPairTable() {
+	const int count = m_props.Count();
+	m_pairTable.SetCount(count * count);
+	m_pairTableSize = count;
+
+	for (int i = 0; i < count; i++) {
+		const surfacephysicsparams_t &phys0 = m_props[i].data.physics;
+		const surfaceaudioparams_t &audio0 = m_props[i].data.audio;
+		for (int j = 0; j < count; j++) {
+			const surfacephysicsparams_t &phys1 = m_props[j].data.physics;
+			const surfaceaudioparams_t &audio1 = m_props[j].data.audio;
+
+			// Same combination rules IVP used: friction and elasticity are multiplied
+			materialpair_t &pair = m_pairTable[i * count + j];
+			pair.friction	= phys0.friction * phys1.friction;
+			pair.elasticity	= clamp(phys0.elasticity * phys1.elasticity, 0.f, 1.f);
+			pair.dampening	= (phys0.dampening + phys1.dampening) * 0.5f;
+
+			// Neither surface makes a hard impact sound below this, see CCollisionEventListener
+			pair.minCollisionSpeed = HL2BULL(max(min(audio0.hardVelocityThreshold, audio1.hardVelocityThreshold), 0.f));
+		}
+	}
 }
 
 CPhysicsSurfaceProps g_SurfaceDatabase;
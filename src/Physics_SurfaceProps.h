@@ -4,14 +4,25 @@
 	#pragma once
 #endif
 
+#include <utlhashtable.h>
+
 enum {
 	MATERIAL_INDEX_SHADOW = 0xF000,
 };
 
+// Combined coefficients for a pair of surfaces, used for every contact between them
+struct materialpair_t {
+	float			friction;
+	float			elasticity;
+	float			dampening;
+	float			minCollisionSpeed;	// Bullet units, smaller hardVelocityThreshold of the two surfaces
+};
+
 class CSurface {
 	public:
 		CUtlSymbol		m_name;
 		surfacedata_t	data;
+		physics_ccdmode_t	m_ccdMode;	// Not part of surfacedata_t, the game doesn't know about it
 };
 
 class CPhysicsSurfaceProps : public IPhysicsSurfaceProps {
@@ -34,6 +45,13 @@ class CPhysicsSurfaceProps : public IPhysicsSurfaceProps {
 
 		void					GetPhysicsParameters(int surfaceDataIndex, surfacephysicsparams_t *pParamsOut) const;
 
+		// UNEXPOSED
+		// Returns NULL if no surface data has been parsed yet
+		const materialpair_t *	GetMaterialPair(int materialIndex0, int materialIndex1) const;
+
+		// UNEXPOSED
+		physics_ccdmode_t		GetCCDMode(int surfaceDataIndex) const;
+
 	private:
 		int						GetReservedSurfaceIndex(const char *pSurfacePropName) const;
 
@@ -43,14 +61,36 @@ class CPhysicsSurfaceProps : public IPhysicsSurfaceProps {
 		void					CopyPhysicsProperties(CSurface *pOut, int baseIndex);
 		bool					AddFileToDatabase(const char *pFilename);
 		int						FindOrAddSound(CUtlSymbol sym);
+		void					BuildMaterialPairTable();
 
 	private:
 		CUtlSymbolTable *		m_strings;
 		CUtlVector<CUtlSymbol>	m_soundList;
 		CUtlVector<CSurface>	m_props;
 		CUtlVector<CUtlSymbol>	m_fileList;
+
+		// Symbol -> index lookups, kept in sync with m_props/m_soundList by ParseSurfaceData
+		CUtlHashtable<unsigned int, int>	m_propTable;
+		CUtlHashtable<unsigned int, int>	m_soundTable;
+		int						m_defaultIndex;
+
+		// Dense m_props.Count() x m_props.Count() table, rebuilt whenever surfaces are added
+		CUtlVector<materialpair_t>	m_pairTable;
+		int						m_pairTableSize;
 };
 
+inline const materialpair_t *CPhysicsSurfaceProps::GetMaterialPair(int materialIndex0, int materialIndex1) const {
+	if (m_pairTableSize <= 0)
+		return NULL;
+
+	// Anything we don't have a row for (such as MATERIAL_INDEX_SHADOW) uses the default surface
+	const int fallback = m_defaultIndex >= 0 ? m_defaultIndex : 0;
+	if (materialIndex0 < 0 || materialIndex0 >= m_pairTableSize) materialIndex0 = fallback;
+	if (materialIndex1 < 0 || materialIndex1 >= m_pairTableSize) materialIndex1 = fallback;
+
+	return &m_pairTable[materialIndex0 * m_pairTableSize + materialIndex1];
+}
+
 extern CPhysicsSurfaceProps g_SurfaceDatabase;
 
 #endif // PHYSICS_SURFACEPROPS_H
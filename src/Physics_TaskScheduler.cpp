@@ -0,0 +1,114 @@
+#include "StdAfx.h"
+
+#include "Physics_TaskScheduler.h"
+
+#include <tbb/task_arena.h>
+#include <tbb/task.h>
+#include <tbb/task_scheduler_init.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/blocked_range.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// Defined in LinearMath/btThreads.cpp, the stock schedulers use these to mark that jobs are in flight.
+void btPushThreadsAreRunning();
+void btPopThreadsAreRunning();
+
+struct ForBodyAdapter {
+	const btIParallelForBody *m_pBody;
+
+	ForBodyAdapter(const btIParallelForBody *pBody) : m_pBody(pBody) {}
+	void operator()(const tbb::blocked_range<int> &range) const {
+		BT_PROFILE("TBB_job");
+		m_pBody->forLoop(range.begin(), range.end());
+	}
+};
+
+struct SumBodyAdapter {
+	const btIParallelSumBody *m_pBody;
+	btScalar m_sum;
+
+	SumBodyAdapter(const btIParallelSumBody *pBody) : m_pBody(pBody), m_sum(0) {}
+	SumBodyAdapter(const SumBodyAdapter &src, tbb::split) : m_pBody(src.m_pBody), m_sum(0) {}
+	void join(const SumBodyAdapter &src) { m_sum += src.m_sum; }
+	void operator()(const tbb::blocked_range<int> &range) {
+		BT_PROFILE("TBB_sumJob");
+		m_sum += m_pBody->sumLoop(range.begin(), range.end());
+	}
+};
+
+/******************************
+* CLASS CPhysicsTaskScheduler
+******************************/
+
+CPhysicsTaskScheduler::CPhysicsTaskScheduler(int numThreads, bool highPriority) : btITaskScheduler("PhysicsArena") {
+	m_pArena = NULL;
+	m_numThreads = clamp(numThreads, 1, getMaxNumThreads());
+	m_bHighPriority = highPriority;
+
+	CreateArena();
+}
+
+CPhysicsTaskScheduler::~CPhysicsTaskScheduler() {
+	delete m_pArena;
+}
+
+void CPhysicsTaskScheduler::CreateArena() {
+	delete m_pArena;
+
+	// Reserve a slot for the simulating thread, it joins in on the work while it waits.
+	m_pArena = new tbb::task_arena(m_numThreads, 1);
+}
+
+int CPhysicsTaskScheduler::getMaxNumThreads() const {
+	return min(int(tbb::task_scheduler_init::default_num_threads()), int(BT_MAX_THREAD_COUNT));
+}
+
+int CPhysicsTaskScheduler::getNumThreads() const {
+	return m_numThreads;
+}
+
+void CPhysicsTaskScheduler::setNumThreads(int numThreads) {
+	numThreads = clamp(numThreads, 1, getMaxNumThreads());
+	if (numThreads == m_numThreads) return;
+
+	m_numThreads = numThreads;
+	CreateArena();
+}
+
+void CPhysicsTaskScheduler::SetHighPriority(bool highPriority) {
+	m_bHighPriority = highPriority;
+}
+
+void CPhysicsTaskScheduler::parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody &body) {
+	ForBodyAdapter tbbBody(&body);
+	btPushThreadsAreRunning();
+
+	m_pArena->execute([&]() {
+		tbb::task_group_context context;
+#if __TBB_TASK_PRIORITY
+		context.set_priority(m_bHighPriority ? tbb::priority_high : tbb::priority_normal);
+#endif
+		tbb::parallel_for(tbb::blocked_range<int>(iBegin, iEnd, grainSize), tbbBody, tbb::simple_partitioner(), context);
+	});
+
+	btPopThreadsAreRunning();
+}
+
+btScalar CPhysicsTaskScheduler::parallelSum(int iBegin, int iEnd, int grainSize, const btIParallelSumBody &body) {
+	SumBodyAdapter tbbBody(&body);
+	btPushThreadsAreRunning();
+
+	m_pArena->execute([&]() {
+		tbb::task_group_context context;
+#if __TBB_TASK_PRIORITY
+		context.set_priority(m_bHighPriority ? tbb::priority_high : tbb::priority_normal);
+#endif
+		tbb::parallel_reduce(tbb::blocked_range<int>(iBegin, iEnd, grainSize), tbbBody, tbb::simple_partitioner(), context);
+	});
+
+	btPopThreadsAreRunning();
+	return tbbBody.m_sum;
+}
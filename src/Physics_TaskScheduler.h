@@ -0,0 +1,39 @@
+#ifndef PHYSICS_TASKSCHEDULER_H
+#define PHYSICS_TASKSCHEDULER_H
+#if defined(_MSC_VER) || (defined(__GNUC__) && __GNUC__ > 3)
+	#pragma once
+#endif
+
+#include "LinearMath/btThreads.h"
+
+namespace tbb {
+	class task_arena;
+}
+
+// Task scheduler owned by a single environment. Work is run inside a private TBB arena, so every
+// environment gets its own thread budget and can't steal workers from another environment.
+// Bullet only has one global scheduler, so the environment swaps this in for the duration of its step.
+class CPhysicsTaskScheduler : public btITaskScheduler {
+	public:
+							CPhysicsTaskScheduler(int numThreads, bool highPriority);
+							~CPhysicsTaskScheduler();
+
+		int					getMaxNumThreads() const;
+		int					getNumThreads() const;
+		void				setNumThreads(int numThreads);
+
+		void				parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody &body);
+		btScalar			parallelSum(int iBegin, int iEnd, int grainSize, const btIParallelSumBody &body);
+
+		bool				IsHighPriority() const { return m_bHighPriority; }
+		void				SetHighPriority(bool highPriority);
+
+	private:
+		void				CreateArena();
+
+		tbb::task_arena *	m_pArena;
+		int					m_numThreads;
+		bool				m_bHighPriority;
+};
+
+#endif // PHYSICS_TASKSCHEDULER_H